@@ -0,0 +1,333 @@
+/*
+
+"DelayArena" platform allocation and counters.
+
+Date: 29/03/2017
+Plugin Name: Delay
+Author: Dimitris Koutsaidis
+
+to do:
+
+*/
+
+
+#include "DelayArena.h"
+#include <string.h>
+#include <stdlib.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#if defined(_WIN32)
+ #define NOMINMAX
+ #include <windows.h>
+ #include <malloc.h>
+#else
+ #include <sys/mman.h>
+ #include <unistd.h>
+#endif
+
+#if defined(__linux__)
+ #include <pthread.h>
+ #include <stdint.h>
+ #include <sys/syscall.h>
+ #include <linux/perf_event.h>
+#endif
+
+
+//==============================================================================
+static std::atomic<long long> liveBytes(0), peakBytes(0), hugePageBytes(0), transparentHugePageBytes(0);
+static std::atomic<int> numArenas(0);
+
+static void addToStats(long long bytes, DelayArena::Backing backing, int arenas)
+{
+	const long long live = (liveBytes += bytes);
+	if (backing == DelayArena::hugePages) hugePageBytes += bytes;
+	if (backing == DelayArena::transparentHugePages) transparentHugePageBytes += bytes;
+	numArenas += arenas;
+
+	long long peak = peakBytes.load();
+	while (live > peak && ! peakBytes.compare_exchange_weak(peak, live)) {}
+}
+
+DelayArena::Stats DelayArena::getStats()
+{
+	Stats s;
+	s.liveBytes = liveBytes.load();
+	s.peakBytes = peakBytes.load();
+	s.hugePageBytes = hugePageBytes.load();
+	s.transparentHugePageBytes = transparentHugePageBytes.load();
+	s.numArenas = numArenas.load();
+	return s;
+}
+
+
+//==============================================================================
+// Sets "backing" to how the memory was obtained when it succeeds.
+static void* allocateHugePages(size_t& numBytes, DelayArena::Backing& backing)
+{
+   #if defined(_WIN32)
+	// Needs the "Lock pages in memory" privilege; fails quietly without it.
+	const size_t pageSize = GetLargePageMinimum();
+	if (pageSize == 0)
+		return nullptr;
+
+	numBytes = (numBytes + pageSize - 1) & ~(pageSize - 1);
+	backing = DelayArena::hugePages;
+	return VirtualAlloc(nullptr, numBytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+   #elif defined(__linux__)
+	const size_t pageSize = DelayArena::hugePageThreshold;
+	numBytes = (numBytes + pageSize - 1) & ~(pageSize - 1);
+
+	void* p = mmap(nullptr, numBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (p != MAP_FAILED)
+	{
+		backing = DelayArena::hugePages;
+		return p;
+	}
+
+	// No reserved huge pages: fall back to transparent huge pages where enabled.
+	p = mmap(nullptr, numBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		return nullptr;
+
+	madvise(p, numBytes, MADV_HUGEPAGE);
+	backing = DelayArena::transparentHugePages;
+	return p;
+   #else
+	(void) numBytes; (void) backing;
+	return nullptr;
+   #endif
+}
+
+static void freeHugePages(void* p, size_t numBytes)
+{
+   #if defined(_WIN32)
+	(void) numBytes;
+	VirtualFree(p, 0, MEM_RELEASE);
+   #elif defined(__linux__)
+	munmap(p, numBytes);
+   #else
+	(void) p; (void) numBytes;
+   #endif
+}
+
+static void* allocateAligned(size_t numBytes)
+{
+   #if defined(_WIN32)
+	void* p = _aligned_malloc(numBytes, DelayArena::alignment);
+   #else
+	void* p = nullptr;
+	if (posix_memalign(&p, DelayArena::alignment, numBytes) != 0)
+		p = nullptr;
+   #endif
+
+	if (p != nullptr)
+		memset(p, 0, numBytes);
+
+	return p;
+}
+
+static void freeAligned(void* p)
+{
+   #if defined(_WIN32)
+	_aligned_free(p);
+   #else
+	free(p);
+   #endif
+}
+
+
+//==============================================================================
+DelayArena::DelayArena() : base(nullptr), size(0), backing(heap)
+{
+}
+
+DelayArena::~DelayArena()
+{
+	release();
+}
+
+void DelayArena::allocate(const Layout& layout, bool allowHugePages)
+{
+	release();
+
+	size_t numBytes = layout.getSize();
+	if (numBytes == 0)
+		return;
+
+	if (allowHugePages && numBytes >= size_t(hugePageThreshold))
+	{
+		base = static_cast<char*>(allocateHugePages(numBytes, backing));
+	}
+
+	if (base == nullptr)
+	{
+		backing = heap;
+		numBytes = layout.getSize();
+		base = static_cast<char*>(allocateAligned(numBytes));
+	}
+
+	if (base == nullptr)
+		throw std::bad_alloc();
+
+	size = numBytes;
+	addToStats((long long) size, backing, 1);
+}
+
+void DelayArena::release()
+{
+	if (base == nullptr)
+		return;
+
+	addToStats(-(long long) size, backing, -1);
+
+	if (backing != heap)
+		freeHugePages(base, size);
+	else
+		freeAligned(base);
+
+	base = nullptr;
+	size = 0;
+	backing = heap;
+}
+
+void DelayArena::swapWith(DelayArena& other)
+{
+	char* const b = base;      base = other.base;           other.base = b;
+	const size_t s = size;     size = other.size;           other.size = s;
+	const Backing k = backing; backing = other.backing;     other.backing = k;
+}
+
+
+//==============================================================================
+#if defined(__linux__)
+static std::atomic<bool> countersUnavailable(false);
+
+// The per-thread counters. The key has no thread-exit destructor, since a thread may exit
+// after the host has unloaded the plugin; instead this static object closes every counter
+// and deletes the key when the binary is unloaded (or the process exits).
+struct ThreadCounters
+{
+	ThreadCounters() : keyCreated(false), keyOnce(PTHREAD_ONCE_INIT) {}
+
+	~ThreadCounters()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		countersUnavailable = true;
+
+		for (size_t i = 0; i < fds.size(); ++i)
+			close(fds[i]);
+
+		if (keyCreated)
+			pthread_key_delete(key);
+	}
+
+	// Registers a newly opened counter so that the teardown closes it.
+	void add(int fd)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		fds.push_back(fd);
+	}
+
+	pthread_key_t key;
+	bool keyCreated;
+	pthread_once_t keyOnce;
+	std::mutex mutex;
+	std::vector<int> fds;
+};
+
+static ThreadCounters threadCounters;
+
+static void createCounterKey()
+{
+	threadCounters.keyCreated = (pthread_key_create(&threadCounters.key, nullptr) == 0);
+
+	if (! threadCounters.keyCreated)
+		countersUnavailable = true;
+}
+
+// The counter of the calling thread, opened on first use. Counts the thread and any threads
+// it starts later (inherit), user space only. Returns -1 where counters are unavailable.
+static int getThreadCounter()
+{
+	if (countersUnavailable)
+		return -1;
+
+	pthread_once(&threadCounters.keyOnce, createCounterKey);
+	if (countersUnavailable)
+		return -1;
+
+	if (void* value = pthread_getspecific(threadCounters.key))
+		return int(reinterpret_cast<intptr_t>(value)) - 1;
+
+	perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = PERF_COUNT_HW_CACHE_MISSES;
+	attr.inherit = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	const int fd = (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+
+	if (fd < 0)
+	{
+		countersUnavailable = true;
+		return -1;
+	}
+
+	threadCounters.add(fd);
+	pthread_setspecific(threadCounters.key, reinterpret_cast<void*>(intptr_t(fd) + 1));
+	return fd;
+}
+
+static long long readCounter(int fd)
+{
+	long long count = 0;
+	return read(fd, &count, sizeof(count)) == (ssize_t) sizeof(count) ? count : 0;
+}
+#endif
+
+CacheMissCounter::CacheMissCounter() : fd(-1), startCount(0)
+{
+}
+
+bool CacheMissCounter::isAvailable()
+{
+   #if defined(__linux__)
+	return ! countersUnavailable;
+   #else
+	return false;
+   #endif
+}
+
+bool CacheMissCounter::start()
+{
+   #if defined(__linux__)
+	fd = getThreadCounter();
+
+	if (fd >= 0)
+	{
+		startCount = readCounter(fd);
+		return true;
+	}
+   #endif
+
+	return false;
+}
+
+long long CacheMissCounter::stop()
+{
+   #if defined(__linux__)
+	if (fd >= 0)
+	{
+		const long long count = readCounter(fd) - startCount;
+		fd = -1;
+		return count;
+	}
+   #endif
+
+	return 0;
+}
@@ -0,0 +1,150 @@
+/*
+
+"DelayArena" class definition.
+
+One contiguous, 64-byte aligned block per plugin instance holding all DSP
+state (per-channel filter state, coefficient blocks, delay lines). The
+processor describes what it needs with a "Layout", in the order the hot
+loop touches it, and allocates the arena in prepareToPlay. Arenas of 2 MB
+or more are backed by huge pages when the OS allows it: reserved huge pages
+if there are any, otherwise (Linux) a mapping advised for transparent huge
+pages. The statistics count the two separately, since the second is only
+a hint.
+
+Process-wide memory counters are kept for all arenas. "CacheMissCounter"
+reads the hardware cache-miss counter of the calling thread (Linux only)
+so the effect of the layout can be measured with many instances running.
+Every thread that measures gets its own counter, opened the first time
+and kept until the plugin binary is unloaded, so instances the host moves
+between its worker threads are still counted. The counters are closed by
+a static teardown rather than a thread-exit destructor, which would call
+into the binary after the host has unloaded it. If the counter cannot be opened
+(kernel.perf_event_paranoid, containers) that is remembered and never
+retried, so measuring costs no system calls where it cannot work.
+
+Date: 29/03/2017
+Plugin Name: Delay
+Author: Dimitris Koutsaidis
+
+to do:
+
+*/
+
+#ifndef DELAYARENA_H_INCLUDED
+#define DELAYARENA_H_INCLUDED
+
+#include <stddef.h>
+#include <new>
+
+
+class DelayArena
+{
+public:
+	enum
+	{
+		alignment = 64,
+		hugePageThreshold = 2*1024*1024
+	};
+
+	// Where an arena's memory came from
+	enum Backing
+	{
+		heap,
+		hugePages,                  // reserved huge pages (MAP_HUGETLB, large pages on Windows)
+		transparentHugePages        // a plain mapping advised for transparent huge pages (Linux)
+	};
+
+	// Number of elements of T that fill whole cache lines and hold at least "num" of them.
+	template <typename T>
+	static size_t alignedCount(size_t num)           { return roundUp(num*sizeof(T))/sizeof(T); }
+
+	class Layout
+	{
+	public:
+		Layout() : size(0) {}
+
+		// Reserves space for "num" objects of T and returns its offset in the arena.
+		template <typename T>
+		size_t add(size_t num)
+		{
+			const size_t offset = size;
+			size += roundUp(num*sizeof(T));
+			return offset;
+		}
+
+		size_t getSize() const                       { return size; }
+
+	private:
+		size_t size;
+	};
+
+	DelayArena();
+	~DelayArena();
+
+	// Allocates zeroed memory for the layout, replacing any previous block.
+	// Must not be called from the audio thread.
+	void allocate(const Layout& layout, bool allowHugePages);
+	void release();
+	void swapWith(DelayArena& other);
+
+	template <typename T>
+	T* get(size_t offset) const                      { return reinterpret_cast<T*>(base + offset); }
+
+	// Default-constructs "num" objects at "offset". They are never destroyed, so T must not own resources.
+	template <typename T>
+	T* construct(size_t offset, size_t num)
+	{
+		T* const first = get<T>(offset);
+		for (size_t i = 0; i < num; ++i)
+			new (first + i) T();
+		return first;
+	}
+
+	size_t getSize() const                           { return size; }
+	Backing getBacking() const                       { return backing; }
+
+	struct Stats
+	{
+		long long liveBytes;
+		long long peakBytes;
+		long long hugePageBytes;                     // reserved huge pages only
+		long long transparentHugePageBytes;          // advised; the kernel's THP setting decides
+		int numArenas;
+	};
+
+	static Stats getStats();
+
+private:
+	static size_t roundUp(size_t numBytes)           { return (numBytes + alignment - 1) & ~size_t(alignment - 1); }
+
+	char* base;
+	size_t size;
+	Backing backing;
+
+	DelayArena(const DelayArena&);
+	DelayArena& operator=(const DelayArena&);
+};
+
+
+class CacheMissCounter
+{
+public:
+	CacheMissCounter();
+
+	// Starts counting the misses of the calling thread; returns false where unsupported.
+	bool start();
+	long long stop();                                // misses since start(), on the same thread
+
+	// False once opening a counter has failed.
+	static bool isAvailable();
+
+private:
+	int fd;
+	long long startCount;
+
+	CacheMissCounter(const CacheMissCounter&);
+	CacheMissCounter& operator=(const CacheMissCounter&);
+};
+
+
+#endif  // DELAYARENA_H_INCLUDED
@@ -14,7 +14,8 @@ to do:
 */
 
 
-class DelayEditor : public AudioProcessorEditor
+class DelayEditor : public AudioProcessorEditor,
+                    private ComboBox::Listener
 {
 public:
     enum
@@ -25,16 +26,46 @@ public:
     };
 
     typedef AudioProcessorValueTreeState::SliderAttachment SliderAttachment;
+    typedef AudioProcessorValueTreeState::ComboBoxAttachment ComboBoxAttachment;
+    typedef AudioProcessorValueTreeState::ButtonAttachment ButtonAttachment;
     
 	DelayEditor(AudioProcessor& parent, AudioProcessorValueTreeState& vts) : AudioProcessorEditor(parent), valueTreeState(vts)
     {
-		tDelayLabel.setText("Delay (s)", dontSendNotification);
-		addAndMakeVisible(tDelayLabel);
-        
-		addAndMakeVisible(tDelaySlider);
-		tDelayAttachment = new SliderAttachment(valueTreeState, "tDelay", tDelaySlider);
+		// Slot A: program selection and the live parameters
+		addProgramList(programLabel, programBox, "Program (A)");
+		programBox.setSelectedId(parent.getCurrentProgram() + 1, dontSendNotification);
+		programBox.addListener(this);
+
+		addSlider(tDelayLabel, tDelaySlider, tDelayAttachment, "tDelay", "Delay (s)");
+		addSlider(BLLabel, BLSlider, BLAttachment, "BL", "Blend");
+		addSlider(FBLabel, FBSlider, FBAttachment, "FB", "Feedback");
+		addSlider(FFLabel, FFSlider, FFAttachment, "FF", "Feedforward");
+
+		// Slot B and the morph between the two
+		addProgramList(morphTargetLabel, morphTargetBox, "Slot B");
+		morphTargetAttachment = new ComboBoxAttachment(valueTreeState, "morphTarget", morphTargetBox);
+
+		addSlider(morphLabel, morphSlider, morphAttachment, "morph", "A/B Morph");
+
+		// Pitch-shifted feedback
+		shimmerButton.setButtonText("Shimmer");
+		addAndMakeVisible(shimmerButton);
+		shimmerAttachment = new ButtonAttachment(valueTreeState, "shimmer", shimmerButton);
+
+		addSlider(pitchLabel, pitchSlider, pitchAttachment, "pitch", "Pitch (st)");
+
+		// Oversampled saturation in the feedback loop
+		oversamplingLabel.setText("Saturation", dontSendNotification);
+		addAndMakeVisible(oversamplingLabel);
+		oversamplingBox.addItem("Off", 1);
+		oversamplingBox.addItem("2x", 2);
+		oversamplingBox.addItem("4x", 3);
+		addAndMakeVisible(oversamplingBox);
+		oversamplingAttachment = new ComboBoxAttachment(valueTreeState, "oversampling", oversamplingBox);
+
+		addSlider(driveLabel, driveSlider, driveAttachment, "drive", "Drive (dB)");
         
-        setSize (paramSliderWidth + paramLabelWidth, paramControlHeight * 2);
+        setSize (paramSliderWidth + paramLabelWidth, paramControlHeight * 12);
     }
 
 	~DelayEditor() {}
@@ -42,11 +73,18 @@ public:
     void resized() override
     {
         Rectangle<int> r = getLocalBounds();
-        {
-			Rectangle<int> tDelayRect = r.removeFromTop(paramControlHeight);
-			tDelayLabel.setBounds(tDelayRect.removeFromLeft(paramLabelWidth));
-			tDelaySlider.setBounds(tDelayRect);
-        }
+
+		layoutRow(r, programLabel, programBox);
+		layoutRow(r, tDelayLabel, tDelaySlider);
+		layoutRow(r, BLLabel, BLSlider);
+		layoutRow(r, FBLabel, FBSlider);
+		layoutRow(r, FFLabel, FFSlider);
+		layoutRow(r, morphTargetLabel, morphTargetBox);
+		layoutRow(r, morphLabel, morphSlider);
+		shimmerButton.setBounds(r.removeFromTop(paramControlHeight).withTrimmedLeft(paramLabelWidth));
+		layoutRow(r, pitchLabel, pitchSlider);
+		layoutRow(r, oversamplingLabel, oversamplingBox);
+		layoutRow(r, driveLabel, driveSlider);
     }
 
     void paint (Graphics& g) override
@@ -56,9 +94,63 @@ public:
     }
     
 private:
+	void comboBoxChanged(ComboBox* box) override
+	{
+		if (box == &programBox)
+			processor.setCurrentProgram(programBox.getSelectedId() - 1);
+	}
+
+	void addSlider(Label& label, Slider& slider, ScopedPointer<SliderAttachment>& attachment, const String& parameterID, const String& text)
+	{
+		label.setText(text, dontSendNotification);
+		addAndMakeVisible(label);
+
+		addAndMakeVisible(slider);
+		attachment = new SliderAttachment(valueTreeState, parameterID, slider);
+	}
+
+	void addProgramList(Label& label, ComboBox& box, const String& text)
+	{
+		label.setText(text, dontSendNotification);
+		addAndMakeVisible(label);
+
+		for (int i = 0; i < processor.getNumPrograms(); ++i)
+			box.addItem(processor.getProgramName(i), i + 1);
+
+		addAndMakeVisible(box);
+	}
+
+	static void layoutRow(Rectangle<int>& r, Component& label, Component& control)
+	{
+		Rectangle<int> row = r.removeFromTop(paramControlHeight);
+		label.setBounds(row.removeFromLeft(paramLabelWidth));
+		control.setBounds(row);
+	}
+
     AudioProcessorValueTreeState& valueTreeState;
     
-	Label tDelayLabel;
-	Slider tDelaySlider;
-	ScopedPointer<SliderAttachment> tDelayAttachment;
+	Label programLabel;
+	ComboBox programBox;
+
+	Label tDelayLabel, BLLabel, FBLabel, FFLabel;
+	Slider tDelaySlider, BLSlider, FBSlider, FFSlider;
+	ScopedPointer<SliderAttachment> tDelayAttachment, BLAttachment, FBAttachment, FFAttachment;
+
+	Label morphTargetLabel, morphLabel;
+	ComboBox morphTargetBox;
+	Slider morphSlider;
+	ScopedPointer<ComboBoxAttachment> morphTargetAttachment;
+	ScopedPointer<SliderAttachment> morphAttachment;
+
+	ToggleButton shimmerButton;
+	Label pitchLabel;
+	Slider pitchSlider;
+	ScopedPointer<ButtonAttachment> shimmerAttachment;
+	ScopedPointer<SliderAttachment> pitchAttachment;
+
+	Label oversamplingLabel, driveLabel;
+	ComboBox oversamplingBox;
+	Slider driveSlider;
+	ScopedPointer<ComboBoxAttachment> oversamplingAttachment;
+	ScopedPointer<SliderAttachment> driveAttachment;
 };
\ No newline at end of file
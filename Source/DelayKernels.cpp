@@ -0,0 +1,621 @@
+/*
+
+"DelayKernels" per-instruction-set implementations.
+
+Each variant lives in its own namespace. On GCC/Clang the SIMD functions
+are compiled with a target attribute, so the file itself is built for the
+baseline architecture and only the selected variant ever executes wider
+instructions. MSVC allows the intrinsics without any extra switches.
+AVX-512 needs VS2017 or later; older compilers simply do not build it.
+
+Date: 29/03/2017
+Plugin Name: Delay
+Author: Dimitris Koutsaidis
+
+to do:
+
+*/
+
+
+#include "DelayKernels.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+ #define DELAY_KERNELS_X86 1
+ #include <immintrin.h>
+ #if defined(_MSC_VER)
+  #include <intrin.h>
+ #else
+  #include <cpuid.h>
+ #endif
+ #if defined(__GNUC__) || (defined(_MSC_VER) && _MSC_VER >= 1911)
+  #define DELAY_KERNELS_AVX512 1
+ #endif
+#endif
+
+// Keep the compiler from fusing multiplies and adds (AVX-512 implies FMA), which
+// would make the variants round differently from each other.
+#if defined(__clang__)
+ #pragma clang fp contract(off)
+#elif defined(__GNUC__)
+ #pragma GCC optimize ("fp-contract=off")
+#endif
+
+#if defined(_MSC_VER)
+ #define DELAY_TARGET(isa)
+#else
+ #define DELAY_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+
+namespace DelayKernels
+{
+
+//==============================================================================
+namespace Scalar
+{
+	static void combUpdate(const float* in, float* out, const float* delayed, float* written, int numSamples,
+	                       float BL, float FB, float FF)
+	{
+		for (int i = 0; i < numSamples; ++i)
+		{
+			const float xhDelayed = delayed[i];
+			const float H = in[i] + FB*xhDelayed;
+
+			out[i] = FF*xhDelayed + BL*H;
+			written[i] = H;
+		}
+	}
+
+	// Output number i of an interpolated read; shared by the tails of the vector variants.
+	static inline float interpolateSample(const float* line, int size, int index, float frac, float increment, int i)
+	{
+		const float offset = frac + float(i)*increment;
+		const float whole = floorf(offset);
+		const float f = offset - whole;
+
+		int i0 = index + int(whole);  if (i0 >= size) i0 -= size;
+		int i1 = i0 + 1;              if (i1 >= size) i1 -= size;
+
+		return line[i0] + f*(line[i1] - line[i0]);
+	}
+
+	static void interpolate(const float* line, int size, int index, float frac, float increment,
+	                        float* out, int numSamples)
+	{
+		for (int i = 0; i < numSamples; ++i)
+			out[i] = interpolateSample(line, size, index, frac, increment, i);
+	}
+
+	static void mix(float* dest, const float* src, float destGain, float srcGain, int numSamples)
+	{
+		for (int i = 0; i < numSamples; ++i)
+			dest[i] = destGain*dest[i] + srcGain*src[i];
+	}
+
+	static void gainRamp(float* data, float startGain, float endGain, int numSamples)
+	{
+		if (numSamples <= 0)
+			return;
+
+		const float step = (endGain - startGain)/float(numSamples);
+
+		for (int i = 0; i < numSamples; ++i)
+			data[i] *= startGain + float(i)*step;
+	}
+
+	static inline float saturateSample(float x, float inputGain, float outputGain)
+	{
+		float v = inputGain*x;
+		v = v < -3.0f ? -3.0f : (v > 3.0f ? 3.0f : v);
+
+		const float v2 = v*v;
+		return outputGain*(v*(27.0f + v2)/(27.0f + 9.0f*v2));
+	}
+
+	static void saturate(float* data, float inputGain, float outputGain, int numSamples)
+	{
+		for (int i = 0; i < numSamples; ++i)
+			data[i] = saturateSample(data[i], inputGain, outputGain);
+	}
+}
+
+
+#if DELAY_KERNELS_X86
+//==============================================================================
+namespace SSE2
+{
+	DELAY_TARGET("sse2")
+	static void combUpdate(const float* in, float* out, const float* delayed, float* written, int numSamples,
+	                       float BL, float FB, float FF)
+	{
+		const __m128 bl = _mm_set1_ps(BL), fb = _mm_set1_ps(FB), ff = _mm_set1_ps(FF);
+		int i = 0;
+
+		for (; i + 4 <= numSamples; i += 4)
+		{
+			const __m128 d = _mm_loadu_ps(delayed + i);
+			const __m128 H = _mm_add_ps(_mm_loadu_ps(in + i), _mm_mul_ps(fb, d));
+
+			_mm_storeu_ps(out + i, _mm_add_ps(_mm_mul_ps(ff, d), _mm_mul_ps(bl, H)));
+			_mm_storeu_ps(written + i, H);
+		}
+
+		Scalar::combUpdate(in + i, out + i, delayed + i, written + i, numSamples - i, BL, FB, FF);
+	}
+
+	DELAY_TARGET("sse2")
+	static void interpolate(const float* line, int size, int index, float frac, float increment,
+	                        float* out, int numSamples)
+	{
+		// No gather before AVX2: positions and weights are vectorised, the loads are not.
+		const __m128 lane = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+		const __m128 inc = _mm_set1_ps(increment);
+		const __m128 fr = _mm_set1_ps(frac);
+		int i = 0;
+
+		for (; i + 4 <= numSamples; i += 4)
+		{
+			const __m128 offset = _mm_add_ps(fr, _mm_mul_ps(_mm_add_ps(_mm_set1_ps(float(i)), lane), inc));
+			const __m128i wholeInt = _mm_cvttps_epi32(offset);  // offsets are never negative
+			const __m128 f = _mm_sub_ps(offset, _mm_cvtepi32_ps(wholeInt));
+
+			int whole[4];
+			float a[4], b[4];
+			_mm_storeu_si128((__m128i*) whole, wholeInt);
+
+			for (int k = 0; k < 4; ++k)
+			{
+				int i0 = index + whole[k];  if (i0 >= size) i0 -= size;
+				int i1 = i0 + 1;            if (i1 >= size) i1 -= size;
+				a[k] = line[i0];
+				b[k] = line[i1];
+			}
+
+			const __m128 va = _mm_loadu_ps(a);
+			_mm_storeu_ps(out + i, _mm_add_ps(va, _mm_mul_ps(f, _mm_sub_ps(_mm_loadu_ps(b), va))));
+		}
+
+		for (; i < numSamples; ++i)
+			out[i] = Scalar::interpolateSample(line, size, index, frac, increment, i);
+	}
+
+	DELAY_TARGET("sse2")
+	static void mix(float* dest, const float* src, float destGain, float srcGain, int numSamples)
+	{
+		const __m128 dg = _mm_set1_ps(destGain), sg = _mm_set1_ps(srcGain);
+		int i = 0;
+
+		for (; i + 4 <= numSamples; i += 4)
+			_mm_storeu_ps(dest + i, _mm_add_ps(_mm_mul_ps(dg, _mm_loadu_ps(dest + i)), _mm_mul_ps(sg, _mm_loadu_ps(src + i))));
+
+		Scalar::mix(dest + i, src + i, destGain, srcGain, numSamples - i);
+	}
+
+	DELAY_TARGET("sse2")
+	static void gainRamp(float* data, float startGain, float endGain, int numSamples)
+	{
+		if (numSamples <= 0)
+			return;
+
+		const float step = (endGain - startGain)/float(numSamples);
+		const __m128 lane = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+		const __m128 start = _mm_set1_ps(startGain), st = _mm_set1_ps(step);
+		int i = 0;
+
+		for (; i + 4 <= numSamples; i += 4)
+		{
+			const __m128 g = _mm_add_ps(start, _mm_mul_ps(_mm_add_ps(_mm_set1_ps(float(i)), lane), st));
+			_mm_storeu_ps(data + i, _mm_mul_ps(_mm_loadu_ps(data + i), g));
+		}
+
+		for (; i < numSamples; ++i)
+			data[i] *= startGain + float(i)*step;
+	}
+
+	DELAY_TARGET("sse2")
+	static void saturate(float* data, float inputGain, float outputGain, int numSamples)
+	{
+		const __m128 ig = _mm_set1_ps(inputGain), og = _mm_set1_ps(outputGain);
+		const __m128 lo = _mm_set1_ps(-3.0f), hi = _mm_set1_ps(3.0f), c27 = _mm_set1_ps(27.0f), c9 = _mm_set1_ps(9.0f);
+		int i = 0;
+
+		for (; i + 4 <= numSamples; i += 4)
+		{
+			const __m128 v = _mm_min_ps(_mm_max_ps(_mm_mul_ps(ig, _mm_loadu_ps(data + i)), lo), hi);
+			const __m128 v2 = _mm_mul_ps(v, v);
+			_mm_storeu_ps(data + i, _mm_mul_ps(og, _mm_div_ps(_mm_mul_ps(v, _mm_add_ps(c27, v2)), _mm_add_ps(c27, _mm_mul_ps(c9, v2)))));
+		}
+
+		for (; i < numSamples; ++i)
+			data[i] = Scalar::saturateSample(data[i], inputGain, outputGain);
+	}
+}
+
+
+//==============================================================================
+namespace AVX2
+{
+	DELAY_TARGET("avx2")
+	static void combUpdate(const float* in, float* out, const float* delayed, float* written, int numSamples,
+	                       float BL, float FB, float FF)
+	{
+		const __m256 bl = _mm256_set1_ps(BL), fb = _mm256_set1_ps(FB), ff = _mm256_set1_ps(FF);
+		int i = 0;
+
+		for (; i + 8 <= numSamples; i += 8)
+		{
+			const __m256 d = _mm256_loadu_ps(delayed + i);
+			const __m256 H = _mm256_add_ps(_mm256_loadu_ps(in + i), _mm256_mul_ps(fb, d));
+
+			_mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_mul_ps(ff, d), _mm256_mul_ps(bl, H)));
+			_mm256_storeu_ps(written + i, H);
+		}
+
+		Scalar::combUpdate(in + i, out + i, delayed + i, written + i, numSamples - i, BL, FB, FF);
+	}
+
+	DELAY_TARGET("avx2")
+	static void interpolate(const float* line, int size, int index, float frac, float increment,
+	                        float* out, int numSamples)
+	{
+		const __m256 lane = _mm256_set_ps(7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f);
+		const __m256 inc = _mm256_set1_ps(increment);
+		const __m256 fr = _mm256_set1_ps(frac);
+		const __m256i base = _mm256_set1_epi32(index);
+		const __m256i sz = _mm256_set1_epi32(size);
+		const __m256i szMinusOne = _mm256_set1_epi32(size - 1);
+		const __m256i one = _mm256_set1_epi32(1);
+		int i = 0;
+
+		for (; i + 8 <= numSamples; i += 8)
+		{
+			const __m256 offset = _mm256_add_ps(fr, _mm256_mul_ps(_mm256_add_ps(_mm256_set1_ps(float(i)), lane), inc));
+			const __m256 whole = _mm256_floor_ps(offset);
+			const __m256 f = _mm256_sub_ps(offset, whole);
+
+			// i0 = index + whole (mod size), i1 = i0 + 1 (mod size)
+			__m256i i0 = _mm256_add_epi32(base, _mm256_cvttps_epi32(whole));
+			i0 = _mm256_sub_epi32(i0, _mm256_and_si256(_mm256_cmpgt_epi32(i0, szMinusOne), sz));
+			__m256i i1 = _mm256_add_epi32(i0, one);
+			i1 = _mm256_sub_epi32(i1, _mm256_and_si256(_mm256_cmpgt_epi32(i1, szMinusOne), sz));
+
+			const __m256 a = _mm256_i32gather_ps(line, i0, 4);
+			const __m256 b = _mm256_i32gather_ps(line, i1, 4);
+
+			_mm256_storeu_ps(out + i, _mm256_add_ps(a, _mm256_mul_ps(f, _mm256_sub_ps(b, a))));
+		}
+
+		for (; i < numSamples; ++i)
+			out[i] = Scalar::interpolateSample(line, size, index, frac, increment, i);
+	}
+
+	DELAY_TARGET("avx2")
+	static void mix(float* dest, const float* src, float destGain, float srcGain, int numSamples)
+	{
+		const __m256 dg = _mm256_set1_ps(destGain), sg = _mm256_set1_ps(srcGain);
+		int i = 0;
+
+		for (; i + 8 <= numSamples; i += 8)
+			_mm256_storeu_ps(dest + i, _mm256_add_ps(_mm256_mul_ps(dg, _mm256_loadu_ps(dest + i)),
+			                                         _mm256_mul_ps(sg, _mm256_loadu_ps(src + i))));
+
+		Scalar::mix(dest + i, src + i, destGain, srcGain, numSamples - i);
+	}
+
+	DELAY_TARGET("avx2")
+	static void gainRamp(float* data, float startGain, float endGain, int numSamples)
+	{
+		if (numSamples <= 0)
+			return;
+
+		const float step = (endGain - startGain)/float(numSamples);
+		const __m256 lane = _mm256_set_ps(7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f);
+		const __m256 start = _mm256_set1_ps(startGain), st = _mm256_set1_ps(step);
+		int i = 0;
+
+		for (; i + 8 <= numSamples; i += 8)
+		{
+			const __m256 g = _mm256_add_ps(start, _mm256_mul_ps(_mm256_add_ps(_mm256_set1_ps(float(i)), lane), st));
+			_mm256_storeu_ps(data + i, _mm256_mul_ps(_mm256_loadu_ps(data + i), g));
+		}
+
+		for (; i < numSamples; ++i)
+			data[i] *= startGain + float(i)*step;
+	}
+
+	DELAY_TARGET("avx2")
+	static void saturate(float* data, float inputGain, float outputGain, int numSamples)
+	{
+		const __m256 ig = _mm256_set1_ps(inputGain), og = _mm256_set1_ps(outputGain);
+		const __m256 lo = _mm256_set1_ps(-3.0f), hi = _mm256_set1_ps(3.0f), c27 = _mm256_set1_ps(27.0f), c9 = _mm256_set1_ps(9.0f);
+		int i = 0;
+
+		for (; i + 8 <= numSamples; i += 8)
+		{
+			const __m256 v = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(ig, _mm256_loadu_ps(data + i)), lo), hi);
+			const __m256 v2 = _mm256_mul_ps(v, v);
+			_mm256_storeu_ps(data + i, _mm256_mul_ps(og, _mm256_div_ps(_mm256_mul_ps(v, _mm256_add_ps(c27, v2)), _mm256_add_ps(c27, _mm256_mul_ps(c9, v2)))));
+		}
+
+		for (; i < numSamples; ++i)
+			data[i] = Scalar::saturateSample(data[i], inputGain, outputGain);
+	}
+}
+
+
+#if DELAY_KERNELS_AVX512
+//==============================================================================
+// GCC 12 warns about "maybe uninitialized" variables inside its own avx512fintrin.h (the
+// undefined source operand of the unmasked intrinsics) once they are inlined here.
+#if defined(__GNUC__) && ! defined(__clang__)
+ #pragma GCC diagnostic push
+ #pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+namespace AVX512
+{
+	DELAY_TARGET("avx512f")
+	static void combUpdate(const float* in, float* out, const float* delayed, float* written, int numSamples,
+	                       float BL, float FB, float FF)
+	{
+		const __m512 bl = _mm512_set1_ps(BL), fb = _mm512_set1_ps(FB), ff = _mm512_set1_ps(FF);
+		int i = 0;
+
+		for (; i + 16 <= numSamples; i += 16)
+		{
+			const __m512 d = _mm512_loadu_ps(delayed + i);
+			const __m512 H = _mm512_add_ps(_mm512_loadu_ps(in + i), _mm512_mul_ps(fb, d));
+
+			_mm512_storeu_ps(out + i, _mm512_add_ps(_mm512_mul_ps(ff, d), _mm512_mul_ps(bl, H)));
+			_mm512_storeu_ps(written + i, H);
+		}
+
+		Scalar::combUpdate(in + i, out + i, delayed + i, written + i, numSamples - i, BL, FB, FF);
+	}
+
+	DELAY_TARGET("avx512f")
+	static void interpolate(const float* line, int size, int index, float frac, float increment,
+	                        float* out, int numSamples)
+	{
+		const __m512 lane = _mm512_set_ps(15.0f, 14.0f, 13.0f, 12.0f, 11.0f, 10.0f, 9.0f, 8.0f,
+		                                  7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f);
+		const __m512 inc = _mm512_set1_ps(increment);
+		const __m512 fr = _mm512_set1_ps(frac);
+		const __m512i base = _mm512_set1_epi32(index);
+		const __m512i sz = _mm512_set1_epi32(size);
+		const __m512i one = _mm512_set1_epi32(1);
+		int i = 0;
+
+		for (; i + 16 <= numSamples; i += 16)
+		{
+			const __m512 offset = _mm512_add_ps(fr, _mm512_mul_ps(_mm512_add_ps(_mm512_set1_ps(float(i)), lane), inc));
+			const __m512 whole = _mm512_roundscale_ps(offset, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+			const __m512 f = _mm512_sub_ps(offset, whole);
+
+			__m512i i0 = _mm512_add_epi32(base, _mm512_cvttps_epi32(whole));
+			i0 = _mm512_mask_sub_epi32(i0, _mm512_cmpge_epi32_mask(i0, sz), i0, sz);
+			__m512i i1 = _mm512_add_epi32(i0, one);
+			i1 = _mm512_mask_sub_epi32(i1, _mm512_cmpge_epi32_mask(i1, sz), i1, sz);
+
+			const __m512 a = _mm512_i32gather_ps(i0, line, 4);
+			const __m512 b = _mm512_i32gather_ps(i1, line, 4);
+
+			_mm512_storeu_ps(out + i, _mm512_add_ps(a, _mm512_mul_ps(f, _mm512_sub_ps(b, a))));
+		}
+
+		for (; i < numSamples; ++i)
+			out[i] = Scalar::interpolateSample(line, size, index, frac, increment, i);
+	}
+
+	DELAY_TARGET("avx512f")
+	static void mix(float* dest, const float* src, float destGain, float srcGain, int numSamples)
+	{
+		const __m512 dg = _mm512_set1_ps(destGain), sg = _mm512_set1_ps(srcGain);
+		int i = 0;
+
+		for (; i + 16 <= numSamples; i += 16)
+			_mm512_storeu_ps(dest + i, _mm512_add_ps(_mm512_mul_ps(dg, _mm512_loadu_ps(dest + i)),
+			                                         _mm512_mul_ps(sg, _mm512_loadu_ps(src + i))));
+
+		Scalar::mix(dest + i, src + i, destGain, srcGain, numSamples - i);
+	}
+
+	DELAY_TARGET("avx512f")
+	static void gainRamp(float* data, float startGain, float endGain, int numSamples)
+	{
+		if (numSamples <= 0)
+			return;
+
+		const float step = (endGain - startGain)/float(numSamples);
+		const __m512 lane = _mm512_set_ps(15.0f, 14.0f, 13.0f, 12.0f, 11.0f, 10.0f, 9.0f, 8.0f,
+		                                  7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f);
+		const __m512 start = _mm512_set1_ps(startGain), st = _mm512_set1_ps(step);
+		int i = 0;
+
+		for (; i + 16 <= numSamples; i += 16)
+		{
+			const __m512 g = _mm512_add_ps(start, _mm512_mul_ps(_mm512_add_ps(_mm512_set1_ps(float(i)), lane), st));
+			_mm512_storeu_ps(data + i, _mm512_mul_ps(_mm512_loadu_ps(data + i), g));
+		}
+
+		for (; i < numSamples; ++i)
+			data[i] *= startGain + float(i)*step;
+	}
+
+	DELAY_TARGET("avx512f")
+	static void saturate(float* data, float inputGain, float outputGain, int numSamples)
+	{
+		const __m512 ig = _mm512_set1_ps(inputGain), og = _mm512_set1_ps(outputGain);
+		const __m512 lo = _mm512_set1_ps(-3.0f), hi = _mm512_set1_ps(3.0f), c27 = _mm512_set1_ps(27.0f), c9 = _mm512_set1_ps(9.0f);
+		int i = 0;
+
+		for (; i + 16 <= numSamples; i += 16)
+		{
+			const __m512 v = _mm512_min_ps(_mm512_max_ps(_mm512_mul_ps(ig, _mm512_loadu_ps(data + i)), lo), hi);
+			const __m512 v2 = _mm512_mul_ps(v, v);
+			_mm512_storeu_ps(data + i, _mm512_mul_ps(og, _mm512_div_ps(_mm512_mul_ps(v, _mm512_add_ps(c27, v2)), _mm512_add_ps(c27, _mm512_mul_ps(c9, v2)))));
+		}
+
+		for (; i < numSamples; ++i)
+			data[i] = Scalar::saturateSample(data[i], inputGain, outputGain);
+	}
+}
+
+#if defined(__GNUC__) && ! defined(__clang__)
+ #pragma GCC diagnostic pop
+#endif
+#endif  // DELAY_KERNELS_AVX512
+#endif  // DELAY_KERNELS_X86
+
+
+//==============================================================================
+// CPU feature detection
+#if DELAY_KERNELS_X86
+static void cpuid(int leaf, int subleaf, unsigned int regs[4])
+{
+   #if defined(_MSC_VER)
+	int r[4];
+	__cpuidex(r, leaf, subleaf);
+	for (int k = 0; k < 4; ++k) regs[k] = (unsigned int) r[k];
+   #else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+   #endif
+}
+
+// Extended register state the OS saves on context switches (XCR0).
+static unsigned long long getEnabledXState()
+{
+   #if defined(_MSC_VER)
+	return (unsigned long long) _xgetbv(0);
+   #else
+	unsigned int lo, hi;
+	__asm__ volatile ("xgetbv" : "=a" (lo), "=d" (hi) : "c" (0));
+	return ((unsigned long long) hi << 32) | lo;
+   #endif
+}
+#endif
+
+static bool detectSupport(Isa isa)
+{
+	if (isa == scalar)
+		return true;
+
+   #if DELAY_KERNELS_X86
+	unsigned int r[4];
+	cpuid(0, 0, r);
+	const unsigned int maxLeaf = r[0];
+
+	cpuid(1, 0, r);
+	const bool hasSSE2 = (r[3] & (1u << 26)) != 0;
+	const bool hasOSXSAVE = (r[2] & (1u << 27)) != 0;
+	const bool hasAVX = (r[2] & (1u << 28)) != 0;
+
+	if (isa == sse2)
+		return hasSSE2;
+
+	if (! (hasOSXSAVE && hasAVX) || maxLeaf < 7)
+		return false;
+
+	const unsigned long long xstate = getEnabledXState();
+	cpuid(7, 0, r);
+
+	if (isa == avx2)
+		return (xstate & 0x6) == 0x6 && (r[1] & (1u << 5)) != 0;
+
+   #if DELAY_KERNELS_AVX512
+	if (isa == avx512)
+		return (xstate & 0xe6) == 0xe6 && (r[1] & (1u << 16)) != 0;
+   #endif
+   #endif
+
+	return false;
+}
+
+
+//==============================================================================
+static Table makeTable(Isa isa)
+{
+	Table t = { scalar, Scalar::combUpdate, Scalar::interpolate, Scalar::mix, Scalar::gainRamp, Scalar::saturate };
+
+   #if DELAY_KERNELS_X86
+	if (isa == sse2)
+	{
+		Table s = { sse2, SSE2::combUpdate, SSE2::interpolate, SSE2::mix, SSE2::gainRamp, SSE2::saturate };
+		t = s;
+	}
+	else if (isa == avx2)
+	{
+		Table s = { avx2, AVX2::combUpdate, AVX2::interpolate, AVX2::mix, AVX2::gainRamp, AVX2::saturate };
+		t = s;
+	}
+   #if DELAY_KERNELS_AVX512
+	else if (isa == avx512)
+	{
+		Table s = { avx512, AVX512::combUpdate, AVX512::interpolate, AVX512::mix, AVX512::gainRamp, AVX512::saturate };
+		t = s;
+	}
+   #endif
+   #endif
+
+	return t;
+}
+
+static Isa chooseIsa()
+{
+	if (const char* requested = getenv("DELAY_KERNEL_ISA"))
+		for (int isa = scalar; isa < numIsas; ++isa)
+			if (strcmp(requested, getName(Isa(isa))) == 0 && detectSupport(Isa(isa)))
+				return Isa(isa);
+
+	for (int isa = numIsas - 1; isa > scalar; --isa)
+		if (detectSupport(Isa(isa)))
+			return Isa(isa);
+
+	return scalar;
+}
+
+// Built during static initialisation, i.e. once when the plugin binary is loaded.
+struct Tables
+{
+	Tables() : selected(chooseIsa())
+	{
+		for (int isa = scalar; isa < numIsas; ++isa)
+		{
+			supported[isa] = detectSupport(Isa(isa));
+			tables[isa] = makeTable(supported[isa] ? Isa(isa) : scalar);
+		}
+	}
+
+	Isa selected;
+	bool supported[numIsas];
+	Table tables[numIsas];
+};
+
+static const Tables& getTables()
+{
+	static const Tables instance;
+	return instance;
+}
+
+static const Tables& tablesAtLoad = getTables();
+
+
+const Table& get()                { return getTables().tables[getTables().selected]; }
+const Table& get(Isa isa)         { return getTables().tables[(isa >= scalar && isa < numIsas) ? isa : scalar]; }
+bool isSupported(Isa isa)         { return isa >= scalar && isa < numIsas && getTables().supported[isa]; }
+
+const char* getName(Isa isa)
+{
+	switch (isa)
+	{
+		case sse2:   return "sse2";
+		case avx2:   return "avx2";
+		case avx512: return "avx512";
+		default:     return "scalar";
+	}
+}
+
+}
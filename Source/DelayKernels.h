@@ -0,0 +1,79 @@
+/*
+
+"DelayKernels" dispatch table.
+
+The inner loops of the delay (comb update, interpolated reads, mixing,
+gain ramps and saturation) are compiled once per instruction set in
+DelayKernels.cpp. The best variant supported by the CPU is picked once
+when the plugin is loaded. Setting the environment variable
+DELAY_KERNEL_ISA to "scalar", "sse2", "avx2" or "avx512" overrides the
+choice (it is ignored if the CPU does not support the requested variant),
+which lets every variant be benchmarked on the same machine.
+
+All variants produce bit-identical results: the vector code performs the
+same operations in the same order as the scalar code and does not use
+fused multiply-add.
+
+Date: 29/03/2017
+Plugin Name: Delay
+Author: Dimitris Koutsaidis
+
+to do:
+
+*/
+
+#ifndef DELAYKERNELS_H_INCLUDED
+#define DELAYKERNELS_H_INCLUDED
+
+
+namespace DelayKernels
+{
+	enum Isa
+	{
+		scalar = 0,
+		sse2,
+		avx2,
+		avx512,
+		numIsas
+	};
+
+	struct Table
+	{
+		Isa isa;
+
+		// Universal comb over one contiguous run of the delay line:
+		//   H = in + FB*delayed;  out = FF*delayed + BL*H;  written = H
+		// "delayed" must not overlap the part of "written" produced by the same call,
+		// i.e. the caller limits a run to at most M samples.
+		void (*combUpdate)(const float* in, float* out, const float* delayed, float* written, int numSamples,
+		                   float BL, float FB, float FF);
+
+		// Linearly interpolated read from a circular buffer of "size" samples, starting
+		// at index + frac (0 <= frac < 1) and advancing by "increment" samples per output.
+		// numSamples*increment must be smaller than size.
+		void (*interpolate)(const float* line, int size, int index, float frac, float increment,
+		                    float* out, int numSamples);
+
+		// dest = destGain*dest + srcGain*src
+		void (*mix)(float* dest, const float* src, float destGain, float srcGain, int numSamples);
+
+		// data *= linear ramp from startGain (first sample) towards endGain (reached after the block)
+		void (*gainRamp)(float* data, float startGain, float endGain, int numSamples);
+
+		// data = outputGain*softClip(inputGain*data), with softClip(v) = v*(27 + v^2)/(27 + 9*v^2)
+		// on v clamped to [-3, 3] (a Pade approximation of tanh that reaches +-1 at the clamp)
+		void (*saturate)(float* data, float inputGain, float outputGain, int numSamples);
+	};
+
+	// The table selected at load time.
+	const Table& get();
+
+	// A specific variant, for benchmarking and verification. Falls back to scalar if unsupported.
+	const Table& get(Isa isa);
+
+	bool isSupported(Isa isa);
+	const char* getName(Isa isa);
+}
+
+
+#endif  // DELAYKERNELS_H_INCLUDED
@@ -0,0 +1,89 @@
+/*
+
+"DelayPresets" class definitions.
+
+Preset bank and A/B morphing.
+
+Slot A is the live parameter set and slot B a program of the bank; both
+are read by the audio thread every block and blended there, so automation
+of either lands on the same samples however fast the host renders. The
+blend is a handful of multiplies, so nothing is precomputed.
+
+Date: 29/03/2017
+Plugin Name: Delay
+Author: Dimitris Koutsaidis
+
+to do:
+
+*/
+
+#ifndef DELAYPRESETS_H_INCLUDED
+#define DELAYPRESETS_H_INCLUDED
+
+#include "UniversalComb.h"
+
+
+struct PresetValues
+{
+	float tDelay;                       // ms
+	CombCoefficients coefficients;
+
+	// (1 - amount)*a + amount*b, with the amount clamped to 0..1
+	static PresetValues morph(const PresetValues& a, const PresetValues& b, float amount)
+	{
+		amount = jlimit(0.0f, 1.0f, amount);
+		const float weightA = 1.0f - amount;
+
+		PresetValues v;
+		v.tDelay = weightA*a.tDelay + amount*b.tDelay;
+		v.coefficients.BL = weightA*a.coefficients.BL + amount*b.coefficients.BL;
+		v.coefficients.FB = weightA*a.coefficients.FB + amount*b.coefficients.FB;
+		v.coefficients.FF = weightA*a.coefficients.FF + amount*b.coefficients.FF;
+		return v;
+	}
+};
+
+
+struct DelayProgram
+{
+	String name;
+	PresetValues values;
+};
+
+
+class PresetBank
+{
+public:
+
+	PresetBank()
+	{
+		// Settings from Zolzer's table of universal comb coefficients, plus a few echoes
+		add("Default",  0.0f,   1.0f,  0.5f,  0.25f);
+		add("FIR Comb", 10.0f,  1.0f,  0.0f,  0.7f);
+		add("IIR Comb", 10.0f,  1.0f,  0.7f,  0.0f);
+		add("Allpass",  50.0f,  0.7f, -0.7f,  1.0f);
+		add("Slapback", 120.0f, 1.0f,  0.0f,  0.6f);
+		add("Echo",     200.0f, 1.0f,  0.6f,  0.5f);
+	}
+
+	int size() const                                        { return programs.size(); }
+	const DelayProgram& operator[](int index) const         { return programs.getReference(jlimit(0, size() - 1, index)); }
+	void rename(int index, const String& newName)           { if (isPositiveAndBelow(index, size())) programs.getReference(index).name = newName; }
+
+private:
+	void add(const String& name, float tDelay, float BL, float FB, float FF)
+	{
+		DelayProgram p;
+		p.name = name;
+		p.values.tDelay = tDelay;
+		p.values.coefficients.BL = BL;
+		p.values.coefficients.FB = FB;
+		p.values.coefficients.FF = FF;
+		programs.add(p);
+	}
+
+	Array<DelayProgram> programs;
+};
+
+
+#endif  // DELAYPRESETS_H_INCLUDED
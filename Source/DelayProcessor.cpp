@@ -16,6 +16,9 @@ to do:
 
 #include "JuceHeader.h"
 #include "DelayEditor.h"
+#include "UniversalComb.h"
+#include "DelayPresets.h"
+#include "DelayState.h"
 #include <math.h> 
 
 
@@ -23,57 +26,118 @@ class DelayProcessor : public AudioProcessor
 {
 public:
 
-	DelayProcessor() : parameters(*this, nullptr)
+	DelayProcessor() : parameters(*this, nullptr), currentProgram(0), previoustDelay(-1.0f), tDelay(0.0f), M(0),
+	                   cacheMissesCounted(0), samplesProcessed(0)
     {
+		// Set DELAY_PERF_COUNTERS=1 to log memory use and cache misses of the delay loop (Linux only)
+		measureCacheMisses = SystemStats::getEnvironmentVariable("DELAY_PERF_COUNTERS", String()).getIntValue() != 0;
+
         parameters.createAndAddParameter ("tDelay", "Delay (s)", String(), NormalisableRange<float> (0, 200, 1), 0, nullptr, nullptr);
-        
+		parameters.createAndAddParameter ("BL", "Blend", String(), NormalisableRange<float> (0, 1, 0.01f), 1.0f, nullptr, nullptr);
+		parameters.createAndAddParameter ("FB", "Feedback", String(), NormalisableRange<float> (-0.95f, 0.95f, 0.01f), 0.5f, nullptr, nullptr);
+		parameters.createAndAddParameter ("FF", "Feedforward", String(), NormalisableRange<float> (0, 1, 0.01f), 0.25f, nullptr, nullptr);
+		parameters.createAndAddParameter ("morph", "A/B Morph", String(), NormalisableRange<float> (0, 1, 0.001f), 0, nullptr, nullptr);
+		parameters.createAndAddParameter ("morphTarget", "Slot B", String(), NormalisableRange<float> (0, float(programs.size() - 1), 1), 0, nullptr, nullptr);
+		parameters.createAndAddParameter ("shimmer", "Shimmer", String(), NormalisableRange<float> (0, 1, 1), 0, nullptr, nullptr);
+		parameters.createAndAddParameter ("pitch", "Pitch (st)", String(), NormalisableRange<float> (-12, 12, 1), 12, nullptr, nullptr);
+		parameters.createAndAddParameter ("oversampling", "Saturation", String(), NormalisableRange<float> (0, 2, 1), 0, nullptr, nullptr);
+		parameters.createAndAddParameter ("drive", "Drive (dB)", String(), NormalisableRange<float> (0, 24, 0.1f), 6.0f, nullptr, nullptr);
+
 		parameters.state = ValueTree(Identifier("Delay"));
     }
 
 	~DelayProcessor() {}
 
-    void prepareToPlay (double, int) override {}
+    void prepareToPlay (double sampleRate, int) override
+	{
+		// All DSP state lives in one arena; the delay tails survive a change of sample rate or
+		// block size (see DelayState.h)
+		state.prepare(sampleRate, jmax(getTotalNumInputChannels(), getTotalNumOutputChannels()));
+
+		previoustDelay = -1.0f;
+	}
     
-    void releaseResources() override {}
+    void releaseResources() override
+	{
+		if (measureCacheMisses)
+		{
+			const DelayArena::Stats stats = DelayArena::getStats();
+			Logger::writeToLog("Delay: " + String(stats.numArenas) + " arenas, " + String(stats.liveBytes) + " bytes live ("
+			                   + String(stats.hugePageBytes) + " on huge pages, " + String(stats.transparentHugePageBytes)
+			                   + " advised for transparent huge pages), peak " + String(stats.peakBytes) + " bytes, "
+			                   + (CacheMissCounter::isAvailable() && samplesProcessed > 0
+			                        ? String(double(cacheMissesCounted)/samplesProcessed, 4) + " cache misses per sample"
+			                        : String("cache-miss counter not available")));
+		}
+	}
 
 	void processBlock(AudioSampleBuffer& buffer, MidiBuffer&) override
 	{
 		// Buffer Parameters
 		int numSamples = buffer.getNumSamples();
 		double sampleRate = getSampleRate();
-		float* const leftChannelDataOut = buffer.getWritePointer(0);
+		const int numChannels = jmin(buffer.getNumChannels(), state.getNumChannels());
+
+
+		// Delay Parameters: the live slot A morphed towards the program in slot B (see DelayPresets.h)
+		PresetValues slotA;
+		slotA.tDelay = *parameters.getRawParameterValue("tDelay");
+		slotA.coefficients.BL = *parameters.getRawParameterValue("BL");
+		slotA.coefficients.FB = *parameters.getRawParameterValue("FB");
+		slotA.coefficients.FF = *parameters.getRawParameterValue("FF");
 
+		const float morph = *parameters.getRawParameterValue("morph");
+		const int slotB = jlimit(0, programs.size() - 1, roundToInt(*parameters.getRawParameterValue("morphTarget")));
+		const PresetValues values = PresetValues::morph(slotA, programs[slotB].values, morph);
+		const CombCoefficients& coefficients = values.coefficients;
+		tDelay = values.tDelay;
 
-		// Delay Parameters
-		tDelay = *parameters.getRawParameterValue("tDelay");
-		const float BL = 1.0f;
-		const float FB = 0.5f;
-		const float FF = 0.25f;
 
+		// Shimmer: pitch-shifted feedback path (a plain repeat at 0 semitones)
+		const bool shimmer = *parameters.getRawParameterValue("shimmer") >= 0.5f;
+		const float pitchRatio = powf(2.0f, *parameters.getRawParameterValue("pitch")/12.0f);
 
-		// Change Delay in Number of Samples
-		if (tDelay != previoustDelay) M = int(round((tDelay/1000)*sampleRate));
+
+		// Oversampled saturation of the repeats (off, 2x or 4x); the dry signal stays clean. Drive
+		// and factor changes are ramped by the saturator and the comb (see Oversampler.h)
+		const int oversampling = getOversamplingFactor();
+		const float drive = Decibels::decibelsToGain(*parameters.getRawParameterValue("drive"));
+
+
+		// Change Delay in Number of Samples (the delay line contents are kept)
+		if (tDelay != previoustDelay)
+		{
+			M = int(round((tDelay/1000)*sampleRate));
+			previoustDelay = tDelay;
+		}
 
 
 		// Delay Implementation
-		if (M != 0)
+		const bool countingCacheMisses = measureCacheMisses && cacheMisses.start();
+
+		for (int ch = 0; ch < numChannels; ++ch)
 		{
-			if (tDelay != previoustDelay)
-			{
-				std::vector<float> Delayline(M, 0);
-				previoustDelay = tDelay;
-			}
-
-			for (int i = 0; i < numSamples; ++i)
-			{
-				float leftChannelDataIn = buffer.getReadPointer(0)[i];
-				float H = leftChannelDataIn + FB*Delayline[M-2];
-
-				leftChannelDataOut[i] = FF*Delayline[M-2] + BL*H;
-
-				std::rotate(Delayline.rbegin(), Delayline.rbegin() + 1, Delayline.rend());
-				Delayline[0] = H;
-			}
+			float* const channelData = buffer.getWritePointer(ch);
+
+			UniversalComb& comb = state.getComb(ch);
+			PitchShifter& shifter = state.getShifter(ch);
+			Oversampler& saturator = state.getSaturator(ch);
+
+			shifter.setRatio(pitchRatio);
+			saturator.setFactor(oversampling);
+			saturator.setDrive(drive);
+
+			comb.setDelay(M);
+			comb.setCoefficients(coefficients);
+			comb.setPitchShifter(shimmer && shifter.isShifting() ? &shifter : nullptr);
+			comb.setSaturator(oversampling > 0 ? &saturator : nullptr);
+			comb.process(channelData, channelData, numSamples);
+		}
+
+		if (countingCacheMisses)
+		{
+			cacheMissesCounted += cacheMisses.stop();
+			samplesProcessed += int64(numSamples)*numChannels;
 		}
     }
 
@@ -83,14 +147,41 @@ public:
     bool acceptsMidi() const override                     { return false; }
     bool producesMidi() const override                    { return false; }
     double getTailLengthSeconds() const override          { return 0; }
-	int getNumPrograms() override                         { return 1; }
-    int getCurrentProgram() override                      { return 0; }
-    void setCurrentProgram (int) override                 { }
-    const String getProgramName (int) override            { return String(); }
-    void changeProgramName (int, const String& ) override { }
+	int getNumPrograms() override                         { return programs.size(); }
+    int getCurrentProgram() override                      { return currentProgram; }
+    const String getProgramName (int index) override      { return programs[index].name; }
+    void changeProgramName (int index, const String& newName) override { programs.rename(index, newName); }
+
+	// Loads a program into slot A.
+    void setCurrentProgram (int index) override
+	{
+		if (! isPositiveAndBelow(index, programs.size()))
+			return;
+
+		currentProgram = index;
+		const PresetValues& values = programs[index].values;
+
+		setParameterValue("tDelay", values.tDelay);
+		setParameterValue("BL", values.coefficients.BL);
+		setParameterValue("FB", values.coefficients.FB);
+		setParameterValue("FF", values.coefficients.FF);
+	}
 
     void getStateInformation (MemoryBlock& destData) override
     {
+		parameters.state.setProperty("program", currentProgram, nullptr);
+
+		// The bank's names, which the host may have changed with changeProgramName
+		ValueTree names = parameters.state.getOrCreateChildWithName("programNames", nullptr);
+		names.removeAllChildren(nullptr);
+
+		for (int i = 0; i < programs.size(); ++i)
+		{
+			ValueTree program("program");
+			program.setProperty("name", programs[i].name, nullptr);
+			names.addChild(program, -1, nullptr);
+		}
+
         ScopedPointer<XmlElement> xml (parameters.state.createXml());
         copyXmlToBinary (*xml, destData);
     }
@@ -101,15 +192,44 @@ public:
         
         if (xmlState != nullptr)
             if (xmlState->hasTagName (parameters.state.getType()))
+            {
                 parameters.state = ValueTree::fromXml (*xmlState);
+				currentProgram = jlimit(0, programs.size() - 1, int(parameters.state.getProperty("program", 0)));
+
+				const ValueTree names = parameters.state.getChildWithName("programNames");
+				for (int i = 0; i < jmin(names.getNumChildren(), programs.size()); ++i)
+					programs.rename(i, names.getChild(i).getProperty("name").toString());
+            }
     }
        
 private:
+	// 0 (saturation off), 2 or 4
+	int getOversamplingFactor() const
+	{
+		const int choice = roundToInt(*parameters.getRawParameterValue("oversampling"));
+		return choice > 0 ? (1 << choice) : 0;
+	}
+
+	void setParameterValue(StringRef parameterID, float value)
+	{
+		if (AudioProcessorParameter* p = parameters.getParameter(parameterID))
+			p->setValueNotifyingHost(parameters.getParameterRange(parameterID).convertTo0to1(value));
+	}
+
     AudioProcessorValueTreeState parameters;
 
+	PresetBank programs;
+	int currentProgram;
+
 	float previoustDelay, tDelay;
     int M;
-	std::vector<float> Delayline;
+
+	DelayState state;
+
+	// Counts whichever thread runs processBlock (see DelayArena.h)
+	bool measureCacheMisses;
+	CacheMissCounter cacheMisses;
+	int64 cacheMissesCounted, samplesProcessed;
 	
 	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(DelayProcessor)
 };
@@ -0,0 +1,142 @@
+/*
+
+"DelayState" class definition.
+
+The per-instance DSP state of the plugin: one comb, pitch shifter and
+saturator per channel, the shifter window and scratch buffers and the
+delay lines, all in one "DelayArena" laid out in the order processBlock
+touches it.
+
+prepare() builds the state for a sample rate and channel count in a new
+arena next to the old one, carries the delay-line contents over
+(resampled with a "PolyphaseResampler" if the rate has changed) and then
+swaps the arenas, so the tails continue across a change of sample rate or
+block size. It allocates and belongs on the message thread, while the
+host is not calling processBlock.
+
+Date: 29/03/2017
+Plugin Name: Delay
+Author: Dimitris Koutsaidis
+
+to do:
+
+*/
+
+#ifndef DELAYSTATE_H_INCLUDED
+#define DELAYSTATE_H_INCLUDED
+
+#include "UniversalComb.h"
+#include "DelayArena.h"
+#include "PolyphaseResampler.h"
+#include <math.h>
+#include <memory>
+
+
+class DelayState
+{
+public:
+	enum
+	{
+		maxDelayMs = 200,
+		pitchWindowMs = 50
+	};
+
+	DelayState() : combs(nullptr), shifters(nullptr), saturators(nullptr), numChannels(0), sampleRate(0) {}
+
+	void prepare(double newSampleRate, int newNumChannels)
+	{
+		const int maxDelay = int(ceil((maxDelayMs/1000.0)*newSampleRate));
+		const int pitchWindow = int(ceil((pitchWindowMs/1000.0)*newSampleRate));
+		const int lineHeadroom = pitchWindow + 2;
+		const size_t channels = size_t(newNumChannels > 0 ? newNumChannels : 0);
+		const size_t lineStride = DelayArena::alignedCount<float>(size_t(maxDelay) + 1 + lineHeadroom);
+		const size_t filterStride = DelayArena::alignedCount<float>(Oversampler::getStorageSize());
+
+		DelayArena::Layout layout;
+		const size_t combsOffset = layout.add<UniversalComb>(channels);
+		const size_t shiftersOffset = layout.add<PitchShifter>(channels);
+		const size_t saturatorsOffset = layout.add<Oversampler>(channels);
+		const size_t windowOffset = layout.add<float>(PitchShifter::windowTableSize);
+		const size_t scratchOffset = layout.add<float>(channels*PitchShifter::scratchSize);
+		const size_t filtersOffset = layout.add<float>(channels*filterStride);
+		const size_t linesOffset = layout.add<float>(channels*lineStride);
+
+		DelayArena newArena;
+		newArena.allocate(layout, true);
+
+		UniversalComb* const newCombs = newArena.construct<UniversalComb>(combsOffset, channels);
+		PitchShifter* const newShifters = newArena.construct<PitchShifter>(shiftersOffset, channels);
+		Oversampler* const newSaturators = newArena.construct<Oversampler>(saturatorsOffset, channels);
+
+		float* const window = newArena.get<float>(windowOffset);
+		PitchShifter::fillWindowTable(window);
+
+		for (size_t ch = 0; ch < channels; ++ch)
+		{
+			newCombs[ch].prepare(newArena.get<float>(linesOffset) + ch*lineStride, maxDelay, lineHeadroom);
+			newShifters[ch].prepare(window, newArena.get<float>(scratchOffset) + ch*PitchShifter::scratchSize, pitchWindow);
+			newSaturators[ch].prepare(newArena.get<float>(filtersOffset) + ch*filterStride);
+		}
+
+		carryOverDelayLines(newCombs, newShifters, int(channels), newSampleRate);
+
+		arena.swapWith(newArena);
+		combs = newCombs;
+		shifters = newShifters;
+		saturators = newSaturators;
+		numChannels = int(channels);
+		sampleRate = newSampleRate;
+	}
+
+	int getNumChannels() const                       { return numChannels; }
+	double getSampleRate() const                     { return sampleRate; }
+
+	UniversalComb& getComb(int channel)              { return combs[channel]; }
+	PitchShifter& getShifter(int channel)            { return shifters[channel]; }
+	Oversampler& getSaturator(int channel)           { return saturators[channel]; }
+
+private:
+	// Copies the contents of the current delay lines into freshly prepared ones, resampling
+	// them if the sample rate has changed.
+	void carryOverDelayLines(UniversalComb* newCombs, PitchShifter* newShifters, int newNumChannels, double newSampleRate)
+	{
+		// With no channels on either side there is nothing to carry, and no comb to ask for its size
+		if (combs == nullptr || numChannels == 0 || newNumChannels == 0 || sampleRate <= 0)
+			return;
+
+		const int numOld = combs[0].getLineSize();
+		const int numNew = std::min(newCombs[0].getLineSize(), int(ceil(numOld*newSampleRate/sampleRate)));
+		std::unique_ptr<PolyphaseResampler> resampler;
+
+		if (newSampleRate != sampleRate)
+			resampler.reset(new PolyphaseResampler(sampleRate, newSampleRate));
+
+		std::vector<float> oldHistory(numOld), newHistory(numNew);
+
+		for (int ch = 0; ch < std::min(newNumChannels, numChannels); ++ch)
+		{
+			combs[ch].getHistory(oldHistory.data(), numOld);
+
+			if (resampler != nullptr)
+				resampler->process(oldHistory.data(), numOld, newHistory.data(), numNew);
+			else
+				std::copy(oldHistory.end() - numNew, oldHistory.end(), newHistory.begin());
+
+			newCombs[ch].setHistory(newHistory.data(), numNew);
+			newShifters[ch].setPhase(shifters[ch].getPhase());
+		}
+	}
+
+	DelayArena arena;
+	UniversalComb* combs;
+	PitchShifter* shifters;
+	Oversampler* saturators;
+	int numChannels;
+	double sampleRate;
+
+	DelayState(const DelayState&);
+	DelayState& operator=(const DelayState&);
+};
+
+
+#endif  // DELAYSTATE_H_INCLUDED
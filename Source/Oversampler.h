@@ -0,0 +1,373 @@
+/*
+
+"Oversampler" class definitions.
+
+2x/4x oversampled saturation for the comb feedback path. Each factor of
+two is a "HalfbandStage": a Kaiser-windowed half-band FIR split into its
+two polyphase branches. One branch is a pure delay (the centre tap), so
+only the other, with half the taps, is convolved. The convolution runs
+over whole blocks, one "mix" kernel call per tap, so it uses the SIMD
+variant picked by DelayKernels. The clipper in between is the
+"saturate" kernel.
+
+Up- and downsampling together delay the signal by getLatency() samples
+at the base rate, which the comb absorbs by reading its delay line that
+much earlier, so the plugin output is not delayed.
+
+A new drive is reached over driveRampLength samples, in steps of
+driveChunk samples that are equal in dB, so automating it does not
+zipper; the output gain is always the inverse of the input gain, so
+small signals stay at unity throughout. A change of factor does not
+restart the filters: both paths run for
+fadeLength samples and their outputs are crossfaded at the 2x rate,
+which the first stage shares. The comb fades its read position over the
+same length as the latency changes.
+
+All buffers are owned by the caller (the per-instance arena).
+
+Date: 29/03/2017
+Plugin Name: Delay
+Author: Dimitris Koutsaidis
+
+to do:
+
+*/
+
+#ifndef OVERSAMPLER_H_INCLUDED
+#define OVERSAMPLER_H_INCLUDED
+
+#include "DelayKernels.h"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+
+class HalfbandStage
+{
+public:
+	enum { maxBranchTaps = 16 };
+
+	HalfbandStage() : K(1), history(1), maxInput(0), upWork(nullptr), downEven(nullptr), downOdd(nullptr), branch(nullptr) {}
+
+	// Floats of storage needed for a stage with 2*K branch taps and blocks of up to maxInput samples.
+	static size_t getStorageSize(int K, int maxInput)  { return size_t(3*(2*K - 1 + maxInput) + maxInput); }
+
+	void prepare(int newK, float* storage, int newMaxInput)
+	{
+		K = newK;
+		history = 2*K - 1;
+		maxInput = newMaxInput;
+		upWork = storage;
+		downEven = upWork + history + maxInput;
+		downOdd = downEven + history + maxInput;
+		branch = downOdd + history + maxInput;
+
+		designTaps();
+		reset();
+	}
+
+	void reset()
+	{
+		memset(upWork, 0, sizeof(float)*history);
+		memset(downEven, 0, sizeof(float)*history);
+		memset(downOdd, 0, sizeof(float)*history);
+	}
+
+	// Delay of an up/down pair, in samples at this stage's input rate.
+	double getLatency() const                         { return double(history); }
+
+	// n input samples -> 2n output samples
+	void upsample(const float* in, float* out, int n, const DelayKernels::Table& kernels)
+	{
+		memcpy(upWork + history, in, sizeof(float)*n);
+
+		// Even outputs: the convolved branch (gain 2 makes up for the inserted zeros)
+		convolve(upWork, branch, n, 2.0f, kernels);
+
+		// Odd outputs: the centre tap, 2*0.5 times the input K-1 samples ago
+		for (int i = 0; i < n; ++i)
+		{
+			out[2*i] = branch[i];
+			out[2*i + 1] = upWork[history + i - (K - 1)];
+		}
+
+		memmove(upWork, upWork + n, sizeof(float)*history);
+	}
+
+	// 2n input samples -> n output samples
+	void downsample(const float* in, float* out, int n, const DelayKernels::Table& kernels)
+	{
+		for (int i = 0; i < n; ++i)
+		{
+			downEven[history + i] = in[2*i];
+			downOdd[history + i] = in[2*i + 1];
+		}
+
+		convolve(downEven, out, n, 1.0f, kernels);
+		kernels.mix(out, downOdd + history - K, 1.0f, 0.5f, n);
+
+		memmove(downEven, downEven + n, sizeof(float)*history);
+		memmove(downOdd, downOdd + n, sizeof(float)*history);
+	}
+
+private:
+	// out[i] = gain * sum_j taps[j]*work[history + i - j]
+	void convolve(const float* work, float* out, int n, float gain, const DelayKernels::Table& kernels) const
+	{
+		memset(out, 0, sizeof(float)*n);
+
+		for (int j = 0; j < 2*K; ++j)
+			kernels.mix(out, work + history - j, 1.0f, gain*taps[j], n);
+	}
+
+	// Non-zero taps of a half-band low-pass of 4K-1 taps, at odd offsets from the centre
+	void designTaps()
+	{
+		const double pi = 3.14159265358979323846;
+		const double beta = 8.0;
+		const int centre = 2*K - 1;
+		double sum = 0.0;
+
+		for (int j = 0; j < 2*K; ++j)
+		{
+			const int offset = 2*j - centre;
+			const double r = offset/double(centre + 1);
+			const double window = besselI0(beta*sqrt(1.0 - r*r))/besselI0(beta);
+
+			taps[j] = float(sin(0.5*pi*offset)/(pi*offset)*window);
+			sum += taps[j];
+		}
+
+		// The branch carries half of the DC gain, the centre tap the other half
+		for (int j = 0; j < 2*K; ++j)
+			taps[j] = float(0.5*taps[j]/sum);
+	}
+
+	static double besselI0(double x)
+	{
+		double sum = 1.0, term = 1.0;
+
+		for (int k = 1; k < 32; ++k)
+		{
+			term *= (x/(2.0*k))*(x/(2.0*k));
+			sum += term;
+		}
+
+		return sum;
+	}
+
+	float taps[maxBranchTaps];
+	int K, history, maxInput;
+	float* upWork;
+	float* downEven;
+	float* downOdd;
+	float* branch;
+};
+
+
+class Oversampler
+{
+public:
+	enum
+	{
+		maxBlock = 256,
+		stage1K = 8,        // 31-tap half-band at 2x
+		stage2K = 4,        // 15-tap half-band at 4x, where the band edge has more room
+		fadeLength = 256,   // base-rate samples of crossfade when the factor changes
+		driveRampLength = 256,
+		driveChunk = 4      // base-rate samples per step of a drive ramp
+	};
+
+	Oversampler() : factor(2), fadeFromFactor(2), fadeRemaining(0), drive(1.0f), targetDrive(1.0f), driveStepPerSample(1.0f),
+	                driveRampRemaining(0), numDriveChunks(0), driveChunkLength(0), halfSample(0.0f),
+	                up1(nullptr), up2(nullptr), fadeFrom(nullptr) {}
+
+	// Floats of storage needed per instance.
+	static size_t getStorageSize()
+	{
+		return HalfbandStage::getStorageSize(stage1K, maxBlock) + HalfbandStage::getStorageSize(stage2K, 2*maxBlock)
+		       + 2*maxBlock + 4*maxBlock + 2*maxBlock;
+	}
+
+	void prepare(float* storage)
+	{
+		stage1.prepare(stage1K, storage, maxBlock);
+		storage += HalfbandStage::getStorageSize(stage1K, maxBlock);
+		stage2.prepare(stage2K, storage, 2*maxBlock);
+		storage += HalfbandStage::getStorageSize(stage2K, 2*maxBlock);
+
+		up1 = storage;
+		up2 = up1 + 2*maxBlock;
+		fadeFrom = up2 + 4*maxBlock;
+
+		reset();
+	}
+
+	// Clears the filters. The comb primes them with its recent history when it switches the
+	// saturator in, rather than let stale state from the last time it was used leak out.
+	// Also jumps to the drive last set instead of ramping to it.
+	void reset()
+	{
+		stage1.reset();
+		stage2.reset();
+		halfSample = 0.0f;
+		fadeRemaining = 0;
+		drive = targetDrive;
+		driveRampRemaining = 0;
+	}
+
+	// 2 or 4. A change is crossfaded over fadeLength samples (see process()).
+	void setFactor(int newFactor)
+	{
+		newFactor = (newFactor >= 4) ? 4 : 2;
+
+		if (newFactor != factor)
+		{
+			// The 4x stage starts from silence unless it is still running for a fade
+			if (newFactor == 4 && fadeRemaining == 0)
+			{
+				stage2.reset();
+				halfSample = 0.0f;
+			}
+
+			fadeFromFactor = factor;
+			factor = newFactor;
+			fadeRemaining = fadeLength;
+		}
+	}
+
+	int getFactor() const                             { return factor; }
+
+	// Gain into the clipper; the output is scaled back so small signals pass at unity. Reached
+	// over driveRampLength samples from the current gain.
+	void setDrive(float gain)
+	{
+		if (gain != targetDrive)
+		{
+			targetDrive = gain;
+			driveRampRemaining = driveRampLength;
+			driveStepPerSample = powf(targetDrive/drive, 1.0f/driveRampLength);
+		}
+	}
+
+	// Latency at the base rate for a factor. The second stage is padded by one sample at 2x
+	// so that the total is a whole number of samples.
+	static int getLatency(int factor)
+	{
+		const int stage1Latency = 2*stage1K - 1;
+		const int stage2Latency = stage2K;
+		return factor >= 4 ? stage1Latency + stage2Latency : stage1Latency;
+	}
+
+	int getLatency() const                            { return getLatency(factor); }
+
+	// Saturates up to maxBlock samples in place.
+	void process(float* data, int numSamples, const DelayKernels::Table& kernels)
+	{
+		planDrive(numSamples);
+		stage1.upsample(data, up1, numSamples, kernels);
+
+		if (fadeRemaining > 0)
+		{
+			// Both factors' paths from the same 2x signal, faded from the old one to the new one
+			const int numUp = 2*numSamples;
+			const int fadeUp = 2*std::min(numSamples, fadeRemaining);
+			const float start = float(fadeLength - fadeRemaining)/fadeLength;
+			const float end = float(fadeLength - fadeRemaining + fadeUp/2)/fadeLength;
+
+			memcpy(fadeFrom, up1, sizeof(float)*numUp);
+			saturate(fadeFromFactor, fadeFrom, numUp, kernels);
+			saturate(factor, up1, numUp, kernels);
+
+			kernels.gainRamp(up1, start, end, fadeUp);
+			kernels.gainRamp(fadeFrom, 1.0f - start, 1.0f - end, fadeUp);
+			kernels.mix(up1, fadeFrom, 1.0f, 1.0f, fadeUp);
+
+			fadeRemaining -= fadeUp/2;
+		}
+		else
+		{
+			saturate(factor, up1, 2*numSamples, kernels);
+		}
+
+		stage1.downsample(up1, data, numSamples, kernels);
+	}
+
+private:
+	// The drive for each chunk of the next numSamples: one chunk unless a ramp is under way.
+	void planDrive(int numSamples)
+	{
+		if (driveRampRemaining == 0)
+		{
+			numDriveChunks = 1;
+			driveChunkLength = numSamples;
+			chunkDrive[0] = drive;
+			return;
+		}
+
+		numDriveChunks = 0;
+		driveChunkLength = driveChunk;
+
+		for (int pos = 0; pos < numSamples; pos += driveChunk)
+		{
+			chunkDrive[numDriveChunks++] = drive;
+
+			const int length = std::min(int(driveChunk), numSamples - pos);
+
+			if (length >= driveRampRemaining)
+			{
+				drive = targetDrive;
+				driveRampRemaining = 0;
+			}
+			else
+			{
+				drive *= powf(driveStepPerSample, float(length));
+				driveRampRemaining -= length;
+			}
+		}
+	}
+
+	// The clipper over numClip samples at "rate" times the base rate, with the planned drive
+	void clip(float* data, int numClip, int rate, const DelayKernels::Table& kernels) const
+	{
+		for (int k = 0, pos = 0; k < numDriveChunks && pos < numClip; ++k)
+		{
+			const int length = std::min(rate*driveChunkLength, numClip - pos);
+			kernels.saturate(data + pos, chunkDrive[k], 1.0f/chunkDrive[k], length);
+			pos += length;
+		}
+	}
+
+	// Saturates numUp samples at the 2x rate in place, at 4x through the second stage.
+	void saturate(int atFactor, float* data, int numUp, const DelayKernels::Table& kernels)
+	{
+		if (atFactor == 4)
+		{
+			stage2.upsample(data, up2, numUp, kernels);
+			clip(up2, 2*numUp, 4, kernels);
+			stage2.downsample(up2, data, numUp, kernels);
+
+			const float last = data[numUp - 1];
+			memmove(data + 1, data, sizeof(float)*(numUp - 1));
+			data[0] = halfSample;
+			halfSample = last;
+		}
+		else
+		{
+			clip(data, numUp, 2, kernels);
+		}
+	}
+
+	HalfbandStage stage1, stage2;
+	int factor, fadeFromFactor, fadeRemaining;
+	float drive, targetDrive, driveStepPerSample;
+	int driveRampRemaining, numDriveChunks, driveChunkLength;
+	float chunkDrive[maxBlock/driveChunk + 1];
+	float halfSample;                                  // padding delay of the 4x stage
+	float* up1;
+	float* up2;
+	float* fadeFrom;                                   // the old factor's path while fading
+};
+
+
+#endif  // OVERSAMPLER_H_INCLUDED
@@ -0,0 +1,151 @@
+/*
+
+"PitchShifter" class definition.
+
+Dual read-head pitch shifter for the feedback path of the universal comb
+("shimmer"). Two heads sweep through a window of W samples behind the
+nominal delay, at "ratio" samples per output sample, half a window apart.
+Each head is faded in and out with a sin^2 window read from a precomputed
+table, so the two gains always sum to one and the jump of a head back to
+the other end of the window is inaudible.
+
+Both heads are read with the dispatched "interpolate" kernel in blocks
+that are only split where a head wraps. The cost per sample is two
+interpolated reads, two table lookups and a mix, whatever the shift
+amount, so it can be budgeted up front.
+
+Date: 29/03/2017
+Plugin Name: Delay
+Author: Dimitris Koutsaidis
+
+to do:
+
+*/
+
+#ifndef PITCHSHIFTER_H_INCLUDED
+#define PITCHSHIFTER_H_INCLUDED
+
+#include "DelayKernels.h"
+#include <math.h>
+#include <algorithm>
+
+
+class PitchShifter
+{
+public:
+	enum
+	{
+		maxChunk = 256,                 // longest block handled per call
+		windowTableSize = 1024,
+		scratchSize = 2*maxChunk        // floats of scratch storage per instance
+	};
+
+	PitchShifter() : windowTable(nullptr), head1(nullptr), head2(nullptr), windowLength(1), phase(0.0), ratio(1.0f) {}
+
+	// Fills the window table shared by all shifters of a plugin instance.
+	static void fillWindowTable(float* table)
+	{
+		for (int i = 0; i < windowTableSize; ++i)
+		{
+			const double s = sin(3.14159265358979323846*i/windowTableSize);
+			table[i] = float(s*s);
+		}
+	}
+
+	// "window" and "scratch" are owned by the caller; the delay line needs windowLength + 2
+	// samples of headroom beyond the longest delay for the heads.
+	void prepare(const float* window, float* scratch, int newWindowLength)
+	{
+		windowTable = window;
+		head1 = scratch;
+		head2 = scratch + maxChunk;
+		windowLength = newWindowLength > 0 ? newWindowLength : 1;
+		phase = 0.0;
+	}
+
+	// Position within the window (0..1), so a sweep can continue after re-preparing.
+	double getPhase() const                          { return phase; }
+	void setPhase(double newPhase)                   { phase = wrap(newPhase); }
+
+	// Pitch ratio between 0.5 and 2 (one octave down/up).
+	void setRatio(float newRatio)                   { ratio = newRatio < 0.5f ? 0.5f : (newRatio > 2.0f ? 2.0f : newRatio); }
+
+	// At a ratio of 1 the heads stand still half a window apart, which would make a fixed two-tap
+	// comb rather than a plain repeat, so the shifter should not be used then.
+	bool isShifting() const                          { return ratio != 1.0f; }
+
+	// Writes numSamples (at most maxChunk) pitch-shifted samples read from around a delay of M
+	// samples into "out" and moves the heads on.
+	void process(const float* line, int size, int writePos, int M, float* out, int numSamples,
+	             const DelayKernels::Table& kernels)
+	{
+		read(line, size, writePos, M, out, numSamples, kernels);
+		advance(numSamples);
+	}
+
+	// Like process(), but leaves the heads where they are, so that the same stretch can be read
+	// around two delays (a crossfade) before advance() moves them on once. The heads never read
+	// less than M + 1 samples behind writePos, so a block of up to M samples only reads what has
+	// already been written.
+	void read(const float* line, int size, int writePos, int M, float* out, int numSamples,
+	          const DelayKernels::Table& kernels) const
+	{
+		double phase2 = phase + 0.5; if (phase2 >= 1.0) phase2 -= 1.0;
+
+		readHead(line, size, writePos, M, phase, getPhaseStep(), head1, numSamples, kernels);
+		readHead(line, size, writePos, M, phase2, getPhaseStep(), head2, numSamples, kernels);
+
+		for (int i = 0; i < numSamples; ++i)
+			out[i] = head1[i] + head2[i];
+	}
+
+	void advance(int numSamples)                     { phase = wrap(phase + numSamples*getPhaseStep()); }
+
+private:
+	static double wrap(double p)                     { return p - floor(p); }
+	double getPhaseStep() const                      { return (1.0 - ratio)/windowLength; }
+
+	// One head at delay M + 1 + phase*W, with phase moving by phaseStep per sample.
+	void readHead(const float* line, int size, int writePos, int M, double headPhase, double phaseStep,
+	              float* out, int numSamples, const DelayKernels::Table& kernels) const
+	{
+		int i = 0;
+
+		while (i < numSamples)
+		{
+			// Samples until the phase leaves [0, 1)
+			int segment = numSamples - i;
+			if (phaseStep > 0.0)      segment = std::min(segment, int(ceil((1.0 - headPhase)/phaseStep)));
+			else if (phaseStep < 0.0) segment = std::min(segment, int(floor(headPhase/-phaseStep)) + 1);
+			if (segment < 1) segment = 1;
+
+			double readPos = double(writePos + i) - (M + 1 + headPhase*windowLength);
+			readPos -= floor(readPos/size)*size;
+			const int index = int(readPos) < size ? int(readPos) : 0;
+
+			kernels.interpolate(line, size, index, float(readPos - index), ratio, out + i, segment);
+
+			const float tablePhase = float(headPhase*windowTableSize);
+			const float tableStep = float(phaseStep*windowTableSize);
+
+			for (int j = 0; j < segment; ++j)
+			{
+				const int k = int(tablePhase + j*tableStep);
+				out[i + j] *= windowTable[k < 0 ? 0 : (k >= windowTableSize ? windowTableSize - 1 : k)];
+			}
+
+			headPhase = wrap(headPhase + segment*phaseStep);
+			i += segment;
+		}
+	}
+
+	const float* windowTable;
+	float* head1;
+	float* head2;
+	int windowLength;
+	double phase;
+	float ratio;
+};
+
+
+#endif  // PITCHSHIFTER_H_INCLUDED
@@ -0,0 +1,103 @@
+/*
+
+"PolyphaseResampler" class definition.
+
+Windowed-sinc polyphase resampler for arbitrary rate ratios, used to carry
+the delay-line contents over when the host changes the sample rate. The
+filter bank holds numPhases + 1 branches of tapsPerPhase taps; fractional
+positions between two branches are interpolated linearly. The cutoff
+follows the lower of the two rates so that downsampling does not alias.
+
+Building the bank allocates, so this belongs on the message thread.
+
+Date: 29/03/2017
+Plugin Name: Delay
+Author: Dimitris Koutsaidis
+
+to do:
+
+*/
+
+#ifndef POLYPHASERESAMPLER_H_INCLUDED
+#define POLYPHASERESAMPLER_H_INCLUDED
+
+#include <vector>
+#include <math.h>
+
+
+class PolyphaseResampler
+{
+public:
+	enum
+	{
+		numPhases = 256,
+		tapsPerPhase = 32
+	};
+
+	PolyphaseResampler(double inputRate, double outputRate)
+		: bank((numPhases + 1)*tapsPerPhase), step(inputRate/outputRate)
+	{
+		const double pi = 3.14159265358979323846;
+		const double cutoff = 0.95*(outputRate < inputRate ? outputRate/inputRate : 1.0);
+
+		for (int p = 0; p <= numPhases; ++p)
+		{
+			float* const h = &bank[p*tapsPerPhase];
+			const double frac = p/double(numPhases);
+			double sum = 0.0;
+
+			for (int k = 0; k < tapsPerPhase; ++k)
+			{
+				// Distance of tap k from the output position, in input samples
+				const double d = (k + 1 - tapsPerPhase/2) - frac;
+				const double sinc = (d == 0.0) ? 1.0 : sin(pi*cutoff*d)/(pi*cutoff*d);
+				const double u = (d + tapsPerPhase/2)/tapsPerPhase;
+				const double blackman = 0.42 - 0.5*cos(2.0*pi*u) + 0.08*cos(4.0*pi*u);
+
+				h[k] = float(sinc*blackman);
+				sum += h[k];
+			}
+
+			for (int k = 0; k < tapsPerPhase; ++k)
+				h[k] = float(h[k]/sum);
+		}
+	}
+
+	// Resamples "in" into "out" so that the last output sample lines up with the last input
+	// sample. Input outside [0, numIn) reads as silence.
+	void process(const float* in, int numIn, float* out, int numOut) const
+	{
+		for (int j = 0; j < numOut; ++j)
+		{
+			const double t = (numIn - 1) - (numOut - 1 - j)*step;
+			const double whole = floor(t);
+			const double phase = (t - whole)*numPhases;
+			const int p = int(phase);
+			const float pf = float(phase - p);
+			const float* const h0 = &bank[p*tapsPerPhase];
+			const float* const h1 = h0 + tapsPerPhase;
+			const int first = int(whole) + 1 - tapsPerPhase/2;
+
+			float acc = 0.0f;
+
+			for (int k = 0; k < tapsPerPhase; ++k)
+			{
+				const int n = first + k;
+
+				if (n >= 0 && n < numIn)
+					acc += (h0[k] + pf*(h1[k] - h0[k]))*in[n];
+			}
+
+			out[j] = acc;
+		}
+	}
+
+	double getStep() const                           { return step; }
+
+private:
+	std::vector<float> bank;
+	double step;                                     // input samples per output sample
+};
+
+
+#endif  // POLYPHASERESAMPLER_H_INCLUDED
@@ -0,0 +1,428 @@
+/*
+
+"UniversalComb" class definitions.
+
+Universal comb filter as described by Zolzer [1]:
+
+	xh(n) = x(n) + FB*xh(n-M)
+	y(n)  = FF*xh(n-M) + BL*xh(n)
+
+"UniversalCombReference" is the straightforward per-sample model of the
+equations above and is kept as the reference every optimised kernel is
+compared against. "UniversalComb" is the block version used by the plugin;
+its inner loop is the "combUpdate" kernel picked by DelayKernels. With a
+"PitchShifter" attached, the shifted signal takes the place of xh(n-M)
+in both equations, so every repeat is shifted further (shimmer). With an
+"Oversampler" attached, only what is written back into the line is
+saturated, so the repeats are driven while BL*xh(n) stays clean. The
+saturator delays what it writes by getLatency() samples, so the line is
+read that much earlier to keep the repeats M samples apart; the output
+is not delayed. Delays shorter than getLatency() + 1 samples are
+lengthened to that while saturating.
+A delay of M = 0 samples bypasses the filter (y = x).
+
+When M changes, xh(n-M) is crossfaded from the old delay to the new one
+over fadeLength samples instead of jumping, and the same is done when
+the shifter is switched in or out, so that neither clicks. With the
+shifter attached on both sides, both delays are read at the same head
+phase. Switching the saturator in or out, or changing its factor, moves
+the read position by the latency, which is faded the same way; what is
+written into the line is faded between the unsaturated and the
+saturated signal too, so that the seam does not click when the read
+position reaches it M samples later. A saturator switched in is first
+primed with the line's recent history. The fade is skipped when M goes
+to or from 0.
+
+Date: 29/03/2017
+Plugin Name: Delay
+Author: Dimitris Koutsaidis
+
+to do:
+
+*/
+
+#ifndef UNIVERSALCOMB_H_INCLUDED
+#define UNIVERSALCOMB_H_INCLUDED
+
+#include "DelayKernels.h"
+#include "PitchShifter.h"
+#include "Oversampler.h"
+#include <vector>
+#include <algorithm>
+
+
+struct CombCoefficients
+{
+	float BL;
+	float FB;
+	float FF;
+};
+
+
+class UniversalCombReference
+{
+public:
+
+	enum { fadeLength = 256 };
+
+	UniversalCombReference(int maxDelay) : xh(maxDelay + 1, 0.0f), n(0), M(0), activeM(0), fadeFromM(0), fadeRemaining(0)
+	{
+		coefficients.BL = 1.0f;
+		coefficients.FB = 0.0f;
+		coefficients.FF = 0.0f;
+	}
+
+	void reset()                                  { std::fill(xh.begin(), xh.end(), 0.0f); n = 0; activeM = M; fadeRemaining = 0; }
+	void setDelay(int newM)                       { M = std::min(std::max(newM, 0), getMaxDelay()); }
+	void setCoefficients(const CombCoefficients& c) { coefficients = c; }
+	int getMaxDelay() const                       { return int(xh.size()) - 1; }
+
+	float processSample(float x)
+	{
+		if (M != activeM)
+		{
+			fadeFromM = activeM;
+			activeM = M;
+			fadeRemaining = (fadeFromM > 0 && M > 0) ? int(fadeLength) : 0;
+		}
+
+		if (M == 0)
+			return x;
+
+		const int size = int(xh.size());
+		float xhDelayed = xh[(n + size - M) % size];
+
+		if (fadeRemaining > 0)
+		{
+			const float g = float(fadeLength - fadeRemaining)/fadeLength;
+			xhDelayed = g*xhDelayed + (1.0f - g)*xh[(n + size - fadeFromM) % size];
+			--fadeRemaining;
+		}
+
+		const float xhNow = x + coefficients.FB*xhDelayed;
+		const float y = coefficients.FF*xhDelayed + coefficients.BL*xhNow;
+
+		xh[n] = xhNow;
+		n = (n + 1) % size;
+
+		return y;
+	}
+
+private:
+	std::vector<float> xh;
+	int n, M;
+	int activeM, fadeFromM, fadeRemaining;
+	CombCoefficients coefficients;
+};
+
+
+class UniversalComb
+{
+public:
+
+	enum { fadeLength = UniversalCombReference::fadeLength };
+
+	UniversalComb() : kernels(&DelayKernels::get()), shifter(nullptr), saturator(nullptr), Delayline(nullptr), size(0), maxDelay(0), writePos(0), M(0),
+	                  activeM(0), activeReadDelay(0), activeShifter(nullptr), activeSaturator(nullptr),
+	                  fadeFromDelay(0), fadeFromShifter(nullptr), fadeFromSaturator(nullptr), fadeRemaining(0)
+	{
+		coefficients.BL = 1.0f;
+		coefficients.FB = 0.0f;
+		coefficients.FF = 0.0f;
+	}
+
+	// Uses "storage" (maxDelay + 1 + headroom samples, owned by the caller) as the delay line
+	// and clears it. The headroom is what a pitch shifter reads beyond the longest delay.
+	void prepare(float* storage, int newMaxDelay, int headroom = 0)
+	{
+		Delayline = storage;
+		maxDelay = newMaxDelay;
+		size = maxDelay + 1 + headroom;
+		writePos = 0;
+		M = std::min(M, maxDelay);
+		reset();
+	}
+
+	void reset()
+	{
+		std::fill(Delayline, Delayline + size, 0.0f);
+		writePos = 0;
+		activeM = M;
+		activeReadDelay = getReadDelay();
+		activeShifter = shifter;
+		activeSaturator = saturator;
+		fadeRemaining = 0;
+	}
+
+	void setDelay(int newM)                       { M = std::min(std::max(newM, 0), getMaxDelay()); }
+	void setCoefficients(const CombCoefficients& c) { coefficients = c; }
+	void setKernels(const DelayKernels::Table& t) { kernels = &t; }
+	void setPitchShifter(PitchShifter* s)         { shifter = s; }
+	void setSaturator(Oversampler* s)             { saturator = s; }
+	int getDelay() const                          { return M; }
+	int getMaxDelay() const                       { return maxDelay; }
+	int getLineSize() const                       { return size; }
+
+	// Copies the newest numSamples (at most getLineSize()) of xh, oldest first.
+	void getHistory(float* dest, int numSamples) const
+	{
+		int pos = writePos - numSamples;
+		if (pos < 0) pos += size;
+
+		for (int i = 0; i < numSamples; ++i)
+		{
+			dest[i] = Delayline[pos];
+			if (++pos == size) pos = 0;
+		}
+	}
+
+	// Replaces the delay line contents with numSamples of history, oldest first.
+	void setHistory(const float* src, int numSamples)
+	{
+		reset();
+
+		if (numSamples > size)
+		{
+			src += numSamples - size;
+			numSamples = size;
+		}
+
+		std::copy(src, src + numSamples, Delayline);
+		writePos = numSamples == size ? 0 : numSamples;
+	}
+
+	// In-place processing (in == out) is allowed.
+	void process(const float* in, float* out, int numSamples)
+	{
+		if (M != activeM || shifter != activeShifter || saturator != activeSaturator || getReadDelay() != activeReadDelay)
+			startFade();
+
+		if (M == 0)
+		{
+			if (in != out)
+				std::copy(in, in + numSamples, out);
+			return;
+		}
+
+		while (fadeRemaining > 0 && numSamples > 0)
+		{
+			const int run = processFade(in, out, numSamples);
+			in += run;
+			out += run;
+			numSamples -= run;
+		}
+
+		if (saturator != nullptr)
+		{
+			processSaturated(in, out, numSamples);
+			return;
+		}
+
+		if (shifter != nullptr)
+		{
+			processShifted(in, out, numSamples);
+			return;
+		}
+
+		const float BL = coefficients.BL;
+		const float FB = coefficients.FB;
+		const float FF = coefficients.FF;
+
+		int readPos = writePos - M;
+		if (readPos < 0) readPos += size;
+
+		// Split the block at the wrap points of both heads, and into runs of at most M
+		// samples so that a run never reads what it writes itself.
+		while (numSamples > 0)
+		{
+			const int run = std::min(std::min(numSamples, M), std::min(size - writePos, size - readPos));
+
+			kernels->combUpdate(in, out, &Delayline[readPos], &Delayline[writePos], run, BL, FB, FF);
+
+			in += run;
+			out += run;
+			numSamples -= run;
+			writePos += run; if (writePos == size) writePos = 0;
+			readPos += run;  if (readPos == size) readPos = 0;
+		}
+	}
+
+private:
+	enum { primeLength = 64 };                    // covers the history of both half-band stages
+
+	// How far back xh(n-M) is read: the saturator's latency earlier while it is attached
+	int getReadDelay() const
+	{
+		return saturator != nullptr ? std::max(M - saturator->getLatency(), 1) : M;
+	}
+
+	void startFade()
+	{
+		fadeFromDelay = activeReadDelay;
+		fadeFromShifter = activeShifter;
+		fadeFromSaturator = activeSaturator;
+		fadeRemaining = (activeM > 0 && M > 0) ? int(fadeLength) : 0;
+
+		activeM = M;
+		activeReadDelay = getReadDelay();
+		activeShifter = shifter;
+		activeSaturator = saturator;
+
+		if (saturator != nullptr && saturator != fadeFromSaturator)
+			primeSaturator();
+	}
+
+	// Runs the newest samples of the line through a saturator that is being switched in, so
+	// its filters hold the signal it is about to continue rather than stale or empty state.
+	void primeSaturator()
+	{
+		float history[primeLength];
+		const int n = std::min(int(primeLength), size);
+
+		readLine(history, n, n);
+		saturator->reset();
+		saturator->process(history, n, *kernels);
+	}
+
+	// One run of the crossfade from the old delayed signal to the new one, with the gains ramped
+	// by the gainRamp kernel. If the saturator changed, what is written is faded from the old
+	// one's output (or the plain signal) to the new one's in the same way. Returns the number of
+	// samples processed.
+	int processFade(const float* in, float* out, int numSamples)
+	{
+		float from[PitchShifter::maxChunk];
+		float to[PitchShifter::maxChunk];
+
+		const int readDelay = activeReadDelay;
+		const int run = std::min(std::min(std::min(numSamples, fadeRemaining), std::min(readDelay, fadeFromDelay)),
+		                         std::min(size - writePos, std::min(int(PitchShifter::maxChunk), int(Oversampler::maxBlock))));
+
+		readDelayed(from, fadeFromDelay, fadeFromShifter, run);
+		readDelayed(to, readDelay, shifter, run);
+
+		if (shifter != nullptr)
+			shifter->advance(run);
+		if (fadeFromShifter != nullptr && fadeFromShifter != shifter)
+			fadeFromShifter->advance(run);
+
+		const float start = float(fadeLength - fadeRemaining)/fadeLength;
+		const float end = float(fadeLength - fadeRemaining + run)/fadeLength;
+		kernels->gainRamp(to, start, end, run);
+		kernels->gainRamp(from, 1.0f - start, 1.0f - end, run);
+		kernels->mix(to, from, 1.0f, 1.0f, run);
+
+		float* const written = &Delayline[writePos];
+		kernels->combUpdate(in, out, to, written, run, coefficients.BL, coefficients.FB, coefficients.FF);
+
+		if (saturator != fadeFromSaturator)
+		{
+			// "from" is free again and holds the old path's version of what is written
+			std::copy(written, written + run, from);
+
+			if (saturator != nullptr)
+				saturator->process(written, run, *kernels);
+			if (fadeFromSaturator != nullptr)
+				fadeFromSaturator->process(from, run, *kernels);
+
+			kernels->gainRamp(written, start, end, run);
+			kernels->gainRamp(from, 1.0f - start, 1.0f - end, run);
+			kernels->mix(written, from, 1.0f, 1.0f, run);
+		}
+		else if (saturator != nullptr)
+		{
+			saturator->process(written, run, *kernels);
+		}
+
+		writePos += run; if (writePos == size) writePos = 0;
+		fadeRemaining -= run;
+		return run;
+	}
+
+	// xh(n-delay) for the next numSamples, through the shifter if there is one. The shifter's
+	// heads are not moved; the caller advances them once per run.
+	void readDelayed(float* dest, int delay, const PitchShifter* source, int numSamples) const
+	{
+		if (source != nullptr)
+			source->read(Delayline, size, writePos, delay, dest, numSamples, *kernels);
+		else
+			readLine(dest, delay, numSamples);
+	}
+
+	// The shifter's heads stay at least M + 1 samples behind, so runs of up to M samples are safe.
+	void processShifted(const float* in, float* out, int numSamples)
+	{
+		float delayed[PitchShifter::maxChunk];
+
+		while (numSamples > 0)
+		{
+			const int run = std::min(std::min(numSamples, M), std::min(size - writePos, int(PitchShifter::maxChunk)));
+
+			shifter->process(Delayline, size, writePos, M, delayed, run, *kernels);
+			kernels->combUpdate(in, out, delayed, &Delayline[writePos], run, coefficients.BL, coefficients.FB, coefficients.FF);
+
+			in += run;
+			out += run;
+			numSamples -= run;
+			writePos += run; if (writePos == size) writePos = 0;
+		}
+	}
+
+	// The line holds sat(xh) delayed by the saturator's latency L, so reading it M - L samples
+	// back gives sat(xh(n-M)) for both the feedback and the feedforward term, while BL*xh(n)
+	// uses the unsaturated value.
+	void processSaturated(const float* in, float* out, int numSamples)
+	{
+		float delayed[Oversampler::maxBlock];
+
+		const int readDelay = activeReadDelay;
+
+		while (numSamples > 0)
+		{
+			const int run = std::min(std::min(numSamples, readDelay), std::min(size - writePos, int(Oversampler::maxBlock)));
+			float* const written = &Delayline[writePos];
+
+			readDelayed(delayed, readDelay, shifter, run);
+			if (shifter != nullptr)
+				shifter->advance(run);
+
+			kernels->combUpdate(in, out, delayed, written, run, coefficients.BL, coefficients.FB, coefficients.FF);
+			saturator->process(written, run, *kernels);
+
+			in += run;
+			out += run;
+			numSamples -= run;
+			writePos += run; if (writePos == size) writePos = 0;
+		}
+	}
+
+	// Copies numSamples of the line starting "delay" samples behind the write position.
+	void readLine(float* dest, int delay, int numSamples) const
+	{
+		int pos = writePos - delay;
+		if (pos < 0) pos += size;
+
+		const int first = std::min(numSamples, size - pos);
+		std::copy(Delayline + pos, Delayline + pos + first, dest);
+		std::copy(Delayline, Delayline + (numSamples - first), dest + first);
+	}
+
+	const DelayKernels::Table* kernels;
+	PitchShifter* shifter;
+	Oversampler* saturator;
+	float* Delayline;
+	int size, maxDelay, writePos, M;
+	CombCoefficients coefficients;
+
+	// Delay, read position, shifter and saturator the last block ran with, and the crossfade
+	// away from the ones before
+	int activeM, activeReadDelay;
+	PitchShifter* activeShifter;
+	Oversampler* activeSaturator;
+	int fadeFromDelay;
+	PitchShifter* fadeFromShifter;
+	Oversampler* fadeFromSaturator;
+	int fadeRemaining;
+};
+
+
+#endif  // UNIVERSALCOMB_H_INCLUDED
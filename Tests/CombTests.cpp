@@ -0,0 +1,501 @@
+/*
+
+"CombTests" test program.
+
+Compares the block "UniversalComb", run with every kernel variant the CPU
+supports, against "UniversalCombReference" on impulses, sine sweeps, white
+noise and randomised parameter automation, for one or several channels.
+Each case is checked in two modes:
+
+	bit-exact   against the float reference (same operations, same order)
+	tolerance   against a double precision model of the same equations
+
+Where the delay changes, the crossfade gains are computed per run in the
+block comb and per sample in the reference, so the float reference is
+then matched within a tolerance too; all variants still have to match
+the scalar one bit for bit. The individual kernels are also compared
+with their scalar versions, a fuzzer varies block size, delay length and
+channel count, and delay jumps and shimmer toggles are checked for
+clicks.
+
+Usage: CombTests [fuzzIterations [seed]]
+
+Date: 29/03/2017
+Plugin Name: Delay
+Author: Dimitris Koutsaidis
+
+to do:
+
+*/
+
+
+#include "DelayTestUtils.h"
+#include "UniversalComb.h"
+
+using namespace DelayTest;
+
+
+//==============================================================================
+// The equations of UniversalCombReference in double precision, for the tolerance mode
+class DoubleReference
+{
+public:
+	DoubleReference(int maxDelay) : xh(maxDelay + 1, 0.0), n(0), M(0), activeM(0), fadeFromM(0), fadeRemaining(0), BL(1.0), FB(0.0), FF(0.0) {}
+
+	void setDelay(int newM)                           { M = std::min(std::max(newM, 0), int(xh.size()) - 1); }
+	void setCoefficients(const CombCoefficients& c)   { BL = c.BL; FB = c.FB; FF = c.FF; }
+
+	double processSample(double x)
+	{
+		const int fadeLength = UniversalCombReference::fadeLength;
+
+		if (M != activeM)
+		{
+			fadeFromM = activeM;
+			activeM = M;
+			fadeRemaining = (fadeFromM > 0 && M > 0) ? fadeLength : 0;
+		}
+
+		if (M == 0)
+			return x;
+
+		const int size = int(xh.size());
+		double xhDelayed = xh[(n + size - M) % size];
+
+		if (fadeRemaining > 0)
+		{
+			const double g = double(fadeLength - fadeRemaining)/fadeLength;
+			xhDelayed = g*xhDelayed + (1.0 - g)*xh[(n + size - fadeFromM) % size];
+			--fadeRemaining;
+		}
+		const double xhNow = x + FB*xhDelayed;
+
+		xh[n] = xhNow;
+		n = (n + 1) % size;
+
+		return FF*xhDelayed + BL*xhNow;
+	}
+
+private:
+	std::vector<double> xh;
+	int n, M;
+	int activeM, fadeFromM, fadeRemaining;
+	double BL, FB, FF;
+};
+
+
+//==============================================================================
+// One test run: a signal per channel, cut into blocks, with the parameters set before each block
+struct Block
+{
+	int numSamples;
+	int M;
+	CombCoefficients coefficients;
+};
+
+struct Scenario
+{
+	int maxDelay;
+	int numChannels;
+	std::vector<std::vector<float> > input;
+	std::vector<Block> blocks;
+
+	bool hasDelayChanges() const
+	{
+		for (size_t b = 1; b < blocks.size(); ++b)
+			if (blocks[b].M != blocks[0].M)
+				return true;
+
+		return false;
+	}
+};
+
+static CombCoefficients makeCoefficients(float BL, float FB, float FF)
+{
+	CombCoefficients c;
+	c.BL = BL;
+	c.FB = FB;
+	c.FF = FF;
+	return c;
+}
+
+static CombCoefficients randomCoefficients(std::mt19937& random)
+{
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f), feedback(-0.95f, 0.95f);
+	return makeCoefficients(unit(random), feedback(random), unit(random));
+}
+
+// Runs the block comb the way processBlock does: every channel in place except the odd ones,
+// which use separate output buffers so that both cases are covered
+static std::vector<std::vector<float> > runBlockComb(const Scenario& s, const DelayKernels::Table& kernels)
+{
+	std::vector<float> lines(size_t(s.numChannels)*size_t(s.maxDelay + 1));
+	std::vector<UniversalComb> combs(s.numChannels);
+	std::vector<std::vector<float> > output(s.input);
+
+	for (int ch = 0; ch < s.numChannels; ++ch)
+	{
+		combs[ch].setKernels(kernels);
+		combs[ch].prepare(&lines[size_t(ch)*size_t(s.maxDelay + 1)], s.maxDelay);
+	}
+
+	int pos = 0;
+
+	for (size_t b = 0; b < s.blocks.size(); ++b)
+	{
+		const Block& block = s.blocks[b];
+
+		for (int ch = 0; ch < s.numChannels; ++ch)
+		{
+			combs[ch].setDelay(block.M);
+			combs[ch].setCoefficients(block.coefficients);
+
+			const float* const in = (ch % 2 == 0) ? &output[ch][pos] : &s.input[ch][pos];
+			combs[ch].process(in, &output[ch][pos], block.numSamples);
+		}
+
+		pos += block.numSamples;
+	}
+
+	return output;
+}
+
+template <typename Reference, typename Sample>
+static std::vector<std::vector<float> > runReference(const Scenario& s)
+{
+	std::vector<std::vector<float> > output(s.input);
+
+	for (int ch = 0; ch < s.numChannels; ++ch)
+	{
+		Reference reference(s.maxDelay);
+		int pos = 0;
+
+		for (size_t b = 0; b < s.blocks.size(); ++b)
+		{
+			reference.setDelay(s.blocks[b].M);
+			reference.setCoefficients(s.blocks[b].coefficients);
+
+			for (int i = 0; i < s.blocks[b].numSamples; ++i, ++pos)
+				output[ch][pos] = float(reference.processSample(Sample(s.input[ch][pos])));
+		}
+	}
+
+	return output;
+}
+
+// Both modes for every supported kernel variant
+static void checkScenario(Results& results, const Scenario& s, const char* description)
+{
+	const std::vector<std::vector<float> > exact = runReference<UniversalCombReference, float>(s);
+	const std::vector<std::vector<float> > precise = runReference<DoubleReference, double>(s);
+	const std::vector<std::vector<float> > scalar = runBlockComb(s, DelayKernels::get(DelayKernels::scalar));
+	const bool fades = s.hasDelayChanges();
+
+	for (int isa = 0; isa < DelayKernels::numIsas; ++isa)
+	{
+		if (! DelayKernels::isSupported(DelayKernels::Isa(isa)))
+			continue;
+
+		const std::vector<std::vector<float> > y = runBlockComb(s, DelayKernels::get(DelayKernels::Isa(isa)));
+
+		for (int ch = 0; ch < s.numChannels; ++ch)
+		{
+			const int n = int(y[ch].size());
+			char what[256];
+
+			snprintf(what, sizeof(what), "%s, %s, channel %d: bit-exact against scalar", description, DelayKernels::getName(DelayKernels::Isa(isa)), ch);
+			results.expect(isBitExact(y[ch].data(), scalar[ch].data(), n), what);
+
+			snprintf(what, sizeof(what), "%s, %s, channel %d: %s", description, DelayKernels::getName(DelayKernels::Isa(isa)), ch,
+			         fades ? "float reference with fades" : "bit-exact");
+			results.expect(fades ? isWithinTolerance(y[ch].data(), exact[ch].data(), n, 1e-5)
+			                     : isBitExact(y[ch].data(), exact[ch].data(), n), what);
+
+			snprintf(what, sizeof(what), "%s, %s, channel %d: tolerance", description, DelayKernels::getName(DelayKernels::Isa(isa)), ch);
+			results.expect(isWithinTolerance(y[ch].data(), precise[ch].data(), n, 1e-4), what);
+		}
+	}
+}
+
+
+//==============================================================================
+// Every kernel of every variant against the scalar one
+static void testKernels(Results& results, std::mt19937& random)
+{
+	const DelayKernels::Table& scalar = DelayKernels::get(DelayKernels::scalar);
+	std::uniform_real_distribution<float> dist(-1.0f, 1.0f), unit(0.0f, 1.0f);
+	const int size = 1024;
+
+	std::vector<float> line(size), a(size), b(size), c(size), d(size), e(size);
+	for (int i = 0; i < size; ++i)
+		line[i] = dist(random);
+
+	for (int isa = 1; isa < DelayKernels::numIsas; ++isa)
+	{
+		if (! DelayKernels::isSupported(DelayKernels::Isa(isa)))
+		{
+			printf("%s not supported here, skipped\n", DelayKernels::getName(DelayKernels::Isa(isa)));
+			continue;
+		}
+
+		const DelayKernels::Table& t = DelayKernels::get(DelayKernels::Isa(isa));
+		char what[128];
+
+		for (int trial = 0; trial < 200; ++trial)
+		{
+			const int n = 1 + int(random() % 300);
+			const float g1 = dist(random), g2 = dist(random), g3 = dist(random);
+
+			for (int i = 0; i < n; ++i)
+			{
+				a[i] = dist(random);
+				b[i] = dist(random);
+			}
+
+			scalar.combUpdate(a.data(), c.data(), b.data(), d.data(), n, g1, g2, g3);
+			t.combUpdate(a.data(), e.data(), b.data(), &line[0], n, g1, g2, g3);
+			snprintf(what, sizeof(what), "combUpdate %s, n = %d", DelayKernels::getName(t.isa), n);
+			results.expect(isBitExact(c.data(), e.data(), n) && isBitExact(d.data(), line.data(), n), what);
+
+			for (int i = 0; i < size; ++i)
+				line[i] = dist(random);
+
+			const int index = int(random() % size);
+			const float frac = unit(random), increment = 0.5f + 1.5f*unit(random);
+			const int m = std::min(n, int((size - 1)/increment));
+			scalar.interpolate(line.data(), size, index, frac, increment, c.data(), m);
+			t.interpolate(line.data(), size, index, frac, increment, e.data(), m);
+			snprintf(what, sizeof(what), "interpolate %s, n = %d", DelayKernels::getName(t.isa), m);
+			results.expect(isBitExact(c.data(), e.data(), m), what);
+
+			std::copy(a.begin(), a.begin() + n, c.begin());
+			std::copy(a.begin(), a.begin() + n, e.begin());
+			scalar.mix(c.data(), b.data(), g1, g2, n);
+			t.mix(e.data(), b.data(), g1, g2, n);
+			snprintf(what, sizeof(what), "mix %s, n = %d", DelayKernels::getName(t.isa), n);
+			results.expect(isBitExact(c.data(), e.data(), n), what);
+
+			std::copy(a.begin(), a.begin() + n, c.begin());
+			std::copy(a.begin(), a.begin() + n, e.begin());
+			scalar.gainRamp(c.data(), g1, g2, n);
+			t.gainRamp(e.data(), g1, g2, n);
+			snprintf(what, sizeof(what), "gainRamp %s, n = %d", DelayKernels::getName(t.isa), n);
+			results.expect(isBitExact(c.data(), e.data(), n), what);
+
+			std::copy(a.begin(), a.begin() + n, c.begin());
+			std::copy(a.begin(), a.begin() + n, e.begin());
+			const float drive = 0.25f + 8.0f*unit(random);
+			scalar.saturate(c.data(), drive, g3, n);
+			t.saturate(e.data(), drive, g3, n);
+			snprintf(what, sizeof(what), "saturate %s, n = %d", DelayKernels::getName(t.isa), n);
+			results.expect(isBitExact(c.data(), e.data(), n), what);
+		}
+	}
+}
+
+// Impulses, sweeps and noise with fixed settings, one channel
+static void testSignals(Results& results, std::mt19937& random)
+{
+	const CombCoefficients settings[] =
+	{
+		makeCoefficients(1.0f, 0.0f, 0.7f),     // FIR comb
+		makeCoefficients(1.0f, 0.7f, 0.0f),     // IIR comb
+		makeCoefficients(0.7f, -0.7f, 1.0f),    // allpass
+		makeCoefficients(1.0f, 0.95f, 0.5f)     // long echo
+	};
+
+	const int delays[] = { 1, 7, 64, 300 };
+	const int blockSizes[] = { 1, 64, 333, 512 };
+
+	for (int signal = 0; signal < numSignals; ++signal)
+		for (int c = 0; c < numElements(settings); ++c)
+			for (int d = 0; d < numElements(delays); ++d)
+			{
+				Scenario s;
+				s.maxDelay = 300;
+				s.numChannels = 1;
+				s.input.push_back(makeSignal(signal, 4096, random));
+
+				const int blockSize = blockSizes[(c + d) % numElements(blockSizes)];
+
+				for (int pos = 0; pos < 4096; pos += blockSize)
+				{
+					Block b = { std::min(blockSize, 4096 - pos), delays[d], settings[c] };
+					s.blocks.push_back(b);
+				}
+
+				char description[128];
+				snprintf(description, sizeof(description), "%s, setting %d, M = %d, block %d", getSignalName(signal), c, delays[d], blockSize);
+				checkScenario(results, s, description);
+			}
+}
+
+// Random scenario: parameters and delay change between blocks of random size
+static Scenario makeRandomScenario(std::mt19937& random, int maxDelay, int numChannels, int maxBlockSize, int numBlocks)
+{
+	Scenario s;
+	s.maxDelay = maxDelay;
+	s.numChannels = numChannels;
+
+	CombCoefficients coefficients = randomCoefficients(random);
+	int M = int(random() % (maxDelay + 1));
+	int total = 0;
+
+	for (int i = 0; i < numBlocks; ++i)
+	{
+		if (random() % 3 == 0) coefficients = randomCoefficients(random);
+		if (random() % 3 == 0) M = int(random() % (maxDelay + 1));
+
+		Block b = { 1 + int(random() % maxBlockSize), M, coefficients };
+		s.blocks.push_back(b);
+		total += b.numSamples;
+	}
+
+	const int signal = int(random() % numSignals);
+	for (int ch = 0; ch < numChannels; ++ch)
+		s.input.push_back(makeSignal(ch == 0 ? signal : int(noise), total, random));
+
+	return s;
+}
+
+// Randomised automation, mono and multichannel
+static void testAutomation(Results& results, std::mt19937& random)
+{
+	for (int trial = 0; trial < 40; ++trial)
+	{
+		const int numChannels = (trial < 20) ? 1 : 2 + trial % 4;
+		const Scenario s = makeRandomScenario(random, 500, numChannels, 700, 30);
+
+		char description[128];
+		snprintf(description, sizeof(description), "automation trial %d, %d channels", trial, numChannels);
+		checkScenario(results, s, description);
+	}
+}
+
+// Block size, delay length and channel count all random
+static void fuzz(Results& results, std::mt19937& random, int iterations)
+{
+	for (int i = 0; i < iterations; ++i)
+	{
+		const int maxDelay = 1 + int(random() % 4000);
+		const int numChannels = 1 + int(random() % 8);
+		const int maxBlockSize = 1 + int(random() % 2048);
+		const Scenario s = makeRandomScenario(random, maxDelay, numChannels, maxBlockSize, 1 + int(random() % 12));
+
+		char description[128];
+		snprintf(description, sizeof(description), "fuzz %d (max delay %d, %d channels, blocks up to %d)", i, maxDelay, numChannels, maxBlockSize);
+		checkScenario(results, s, description);
+	}
+}
+
+
+// Largest step between neighbouring samples
+static float getMaxStep(const std::vector<float>& y, int start, int end)
+{
+	float step = 0.0f;
+	for (int i = start + 1; i < end; ++i)
+		step = std::max(step, fabsf(y[i] - y[i - 1]));
+	return step;
+}
+
+// A jump of the delay and toggling the shifter or the saturator must not click: through a
+// pure delay (BL = 0, FF = 1), the output of a 1 kHz sine may not step more than the sine
+// itself does (about 0.065 at 48 kHz), or twice that with the octave-up shifter. Saturator
+// changes are checked until well after the read position has passed the switch point.
+static void testCrossfade(Results& results)
+{
+	const double pi = 3.14159265358979323846;
+	const int numSamples = 16384, maxDelay = 4000, window = 2400;
+
+	std::vector<float> x(numSamples), y(numSamples);
+	for (int i = 0; i < numSamples; ++i)
+		x[i] = float(0.5*sin(2.0*pi*1000.0*i/48000.0));
+
+	std::vector<float> line(maxDelay + 1 + window + 2), windowTable(PitchShifter::windowTableSize), scratch(PitchShifter::scratchSize);
+	std::vector<float> filters(Oversampler::getStorageSize());
+	PitchShifter::fillWindowTable(windowTable.data());
+
+	for (int isa = 0; isa < DelayKernels::numIsas; ++isa)
+	{
+		if (! DelayKernels::isSupported(DelayKernels::Isa(isa)))
+			continue;
+
+		const DelayKernels::Table& kernels = DelayKernels::get(DelayKernels::Isa(isa));
+
+		UniversalComb comb;
+		comb.setKernels(kernels);
+		comb.prepare(line.data(), maxDelay, window + 2);
+		comb.setCoefficients(makeCoefficients(0.0f, 0.0f, 1.0f));
+
+		PitchShifter shifter;
+		shifter.prepare(windowTable.data(), scratch.data(), window);
+		shifter.setRatio(2.0f);
+
+		// 0-2047: M = 100, then M = 1337, shifter in at 4096, M = 2000 at 5120 with the shifter
+		// still attached, and the shifter out again at 6144
+		for (int pos = 0; pos < numSamples; pos += 128)
+		{
+			comb.setDelay(pos < 2048 ? 100 : (pos < 5120 ? 1337 : 2000));
+			comb.setPitchShifter((pos >= 4096 && pos < 6144) ? &shifter : nullptr);
+			comb.process(&x[pos], &y[pos], 128);
+		}
+
+		char what[128];
+		snprintf(what, sizeof(what), "%s: delay jump without a click (step %.3f)", DelayKernels::getName(kernels.isa), getMaxStep(y, 1500, 4000));
+		results.expect(getMaxStep(y, 1500, 4000) < 0.08f, what);
+
+		snprintf(what, sizeof(what), "%s: delay jump while shifting without a click (step %.3f)", DelayKernels::getName(kernels.isa), getMaxStep(y, 4800, 5800));
+		results.expect(getMaxStep(y, 4800, 5800) < 0.16f, what);
+
+		snprintf(what, sizeof(what), "%s: shimmer toggles without a click (step %.3f)", DelayKernels::getName(kernels.isa), getMaxStep(y, 4000, 8192));
+		results.expect(getMaxStep(y, 4000, 8192) < 0.16f, what);
+
+		// Saturation at 2x with M = 1000, M = 1017 at 2048, 4x at 4096, off at 8192 and 2x
+		// again at 12288
+		Oversampler saturator;
+		saturator.prepare(filters.data());
+		saturator.setDrive(1.0f);
+
+		comb.prepare(line.data(), maxDelay, window + 2);
+		comb.setPitchShifter(nullptr);
+
+		for (int pos = 0; pos < numSamples; pos += 128)
+		{
+			saturator.setFactor(pos >= 4096 && pos < 8192 ? 4 : 2);
+			comb.setDelay(pos < 2048 ? 1000 : 1017);
+			comb.setSaturator(pos < 8192 || pos >= 12288 ? &saturator : nullptr);
+			comb.process(&x[pos], &y[pos], 128);
+		}
+
+		const int checks[][2] = { { 1500, 4000 }, { 4000, 8000 }, { 8000, 12000 }, { 12000, numSamples } };
+		const char* const names[] = { "delay jump while saturating", "2x to 4x", "saturation off", "saturation on" };
+
+		for (int c = 0; c < numElements(checks); ++c)
+		{
+			const float step = getMaxStep(y, checks[c][0], checks[c][1]);
+			snprintf(what, sizeof(what), "%s: %s without a click (step %.3f)", DelayKernels::getName(kernels.isa), names[c], step);
+			results.expect(step < 0.08f, what);
+		}
+	}
+}
+
+
+//==============================================================================
+int main(int argc, char* argv[])
+{
+	const int iterations = argc > 1 ? atoi(argv[1]) : 200;
+	const unsigned seed = argc > 2 ? unsigned(strtoul(argv[2], nullptr, 10)) : 1u;
+
+	printf("kernels: %s selected, seed %u\n", DelayKernels::getName(DelayKernels::get().isa), seed);
+
+	std::mt19937 random(seed);
+	Results results;
+
+	testKernels(results, random);
+	testSignals(results, random);
+	testAutomation(results, random);
+	fuzz(results, random, iterations);
+	testCrossfade(results);
+
+	return results.finish("CombTests");
+}
@@ -0,0 +1,273 @@
+/*
+
+"DelayBench" benchmark program.
+
+Timings to be rerun on each machine the plugin is deployed to; the
+numbers depend on the CPU and its caches, so nothing here passes or
+fails.
+
+	arena   many plugin instances with their DSP state in one DelayArena
+	        each, against the same state scattered over the heap the way
+	        separate allocations leave it: time per sample, cache misses
+	        (where the counter is available) and memory use
+
+	oversampling
+	        one channel through the comb with saturation off, 2x and 4x,
+	        with the shimmer off and on, for every kernel variant the CPU
+	        supports
+
+Each timing is the best of numRuns runs, alternating between the cases
+so that none gets a cache or clock-speed advantage.
+
+Usage: DelayBench [arena|oversampling] [numInstances]
+
+Date: 29/03/2017
+Plugin Name: Delay
+Author: Dimitris Koutsaidis
+
+to do:
+
+*/
+
+
+#include "DelayTestUtils.h"
+#include "DelayState.h"
+#include <chrono>
+#include <memory>
+#include <string>
+
+using namespace DelayTest;
+
+
+enum { numRuns = 5 };
+
+
+//==============================================================================
+struct Timing
+{
+	double nsPerSample;
+	double missesPerSample;                          // negative where not counted
+};
+
+// Runs "process(block)" for numBlocks blocks of blockSize samples on every channel of every
+// instance, round robin like a host, and returns the cost per channel-sample.
+template <typename Instances>
+static Timing timeInstances(Instances& instances, int numChannels, int blockSize, int numBlocks)
+{
+	std::vector<float> buffer(size_t(instances.size())*size_t(numChannels)*size_t(blockSize));
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> dist(-0.5f, 0.5f);
+	for (size_t i = 0; i < buffer.size(); ++i)
+		buffer[i] = dist(random);
+
+	CacheMissCounter counter;
+	const bool counting = counter.start();
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	for (int b = 0; b < numBlocks; ++b)
+		for (size_t i = 0; i < instances.size(); ++i)
+			for (int ch = 0; ch < numChannels; ++ch)
+			{
+				float* const data = &buffer[(i*numChannels + ch)*size_t(blockSize)];
+				instances[i].comb(ch).process(data, data, blockSize);
+			}
+
+	const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+	const long long misses = counting ? counter.stop() : -1;
+	const double numSamples = double(numBlocks)*blockSize*numChannels*instances.size();
+
+	Timing t;
+	t.nsPerSample = ns/numSamples;
+	t.missesPerSample = counting ? misses/numSamples : -1.0;
+	return t;
+}
+
+
+//==============================================================================
+// One instance's DSP state in an arena, as the plugin prepares it
+struct ArenaInstance
+{
+	ArenaInstance(int numChannels, double sampleRate) : state(new DelayState())
+	{
+		state->prepare(sampleRate, numChannels);
+	}
+
+	UniversalComb& comb(int ch)                     { return state->getComb(ch); }
+
+	std::shared_ptr<DelayState> state;
+};
+
+// The same state as separate heap allocations, with unrelated allocations in between (as the
+// parameter tree, editor and host leave them)
+struct ScatteredInstance
+{
+	ScatteredInstance(int numChannels, int maxDelay, int pitchWindow, std::mt19937& random)
+	{
+		for (int ch = 0; ch < numChannels; ++ch)
+		{
+			padding.push_back(std::shared_ptr<std::vector<char> >(new std::vector<char>(16 + random() % 4096)));
+			combs.push_back(std::shared_ptr<UniversalComb>(new UniversalComb()));
+			padding.push_back(std::shared_ptr<std::vector<char> >(new std::vector<char>(16 + random() % 4096)));
+			lines.push_back(std::shared_ptr<std::vector<float> >(new std::vector<float>(size_t(maxDelay) + 1 + pitchWindow + 2)));
+			combs.back()->prepare(lines.back()->data(), maxDelay, pitchWindow + 2);
+		}
+	}
+
+	UniversalComb& comb(int ch)                     { return *combs[ch]; }
+
+	std::vector<std::shared_ptr<UniversalComb> > combs;
+	std::vector<std::shared_ptr<std::vector<float> > > lines;
+	std::vector<std::shared_ptr<std::vector<char> > > padding;
+};
+
+template <typename Instances>
+static void setUp(Instances& instances, int numChannels, int M)
+{
+	CombCoefficients c;
+	c.BL = 1.0f;
+	c.FB = 0.5f;
+	c.FF = 0.25f;
+
+	for (size_t i = 0; i < instances.size(); ++i)
+		for (int ch = 0; ch < numChannels; ++ch)
+		{
+			instances[i].comb(ch).setDelay(M - int(i % 64));
+			instances[i].comb(ch).setCoefficients(c);
+		}
+}
+
+static void printTiming(const char* name, const Timing& t)
+{
+	if (t.missesPerSample >= 0.0)
+		printf("  %-10s %7.2f ns/sample  %8.4f cache misses/sample\n", name, t.nsPerSample, t.missesPerSample);
+	else
+		printf("  %-10s %7.2f ns/sample  (cache-miss counter not available)\n", name, t.nsPerSample);
+}
+
+static void benchArena(int numInstances)
+{
+	const int numChannels = 2, sampleRate = 48000;
+	const int maxDelay = sampleRate*DelayState::maxDelayMs/1000, pitchWindow = sampleRate*DelayState::pitchWindowMs/1000, M = sampleRate/8;
+	const int blockSize = 256, numBlocks = 400;
+
+	printf("arena: %d instances x %d channels, %d-sample lines, blocks of %d\n", numInstances, numChannels, maxDelay, blockSize);
+
+	std::mt19937 random(1);
+	std::vector<ScatteredInstance> scattered;
+	for (int i = 0; i < numInstances; ++i)
+		scattered.push_back(ScatteredInstance(numChannels, maxDelay, pitchWindow, random));
+
+	std::vector<ArenaInstance> arenas;
+	for (int i = 0; i < numInstances; ++i)
+		arenas.push_back(ArenaInstance(numChannels, sampleRate));
+
+	setUp(scattered, numChannels, M);
+	setUp(arenas, numChannels, M);
+
+	// Warm up both, then alternate so that neither gets a cache or frequency advantage
+	timeInstances(scattered, numChannels, blockSize, 20);
+	timeInstances(arenas, numChannels, blockSize, 20);
+
+	Timing s = timeInstances(scattered, numChannels, blockSize, numBlocks);
+	Timing a = timeInstances(arenas, numChannels, blockSize, numBlocks);
+
+	for (int run = 1; run < numRuns; ++run)
+	{
+		s.nsPerSample = std::min(s.nsPerSample, timeInstances(scattered, numChannels, blockSize, numBlocks).nsPerSample);
+		a.nsPerSample = std::min(a.nsPerSample, timeInstances(arenas, numChannels, blockSize, numBlocks).nsPerSample);
+	}
+
+	printTiming("scattered", s);
+	printTiming("arena", a);
+
+	const DelayArena::Stats stats = DelayArena::getStats();
+	printf("  arena memory: %lld bytes in %d arenas (%lld on huge pages, %lld advised for transparent huge pages)\n",
+	       stats.liveBytes, stats.numArenas, stats.hugePageBytes, stats.transparentHugePageBytes);
+}
+
+
+//==============================================================================
+enum { numSaturationModes = 3 };                     // off, 2x, 4x
+
+// One channel of the plugin's state set up for a saturation mode, shimmer and kernel variant
+struct SaturationInstance
+{
+	SaturationInstance(int factor, bool shimmer, DelayKernels::Isa isa) : state(new DelayState())
+	{
+		const int sampleRate = 48000;
+		state->prepare(sampleRate, 1);
+
+		CombCoefficients c;
+		c.BL = 1.0f;
+		c.FB = 0.5f;
+		c.FF = 0.25f;
+
+		UniversalComb& comb = state->getComb(0);
+		comb.setKernels(DelayKernels::get(isa));
+		comb.setDelay(sampleRate/10);
+		comb.setCoefficients(c);
+
+		state->getShifter(0).setRatio(2.0f);
+		comb.setPitchShifter(shimmer ? &state->getShifter(0) : nullptr);
+
+		state->getSaturator(0).setFactor(factor);
+		state->getSaturator(0).setDrive(4.0f);
+		comb.setSaturator(factor > 0 ? &state->getSaturator(0) : nullptr);
+	}
+
+	UniversalComb& comb(int)                         { return state->getComb(0); }
+
+	std::shared_ptr<DelayState> state;
+};
+
+static void benchOversampling()
+{
+	const int factors[numSaturationModes] = { 0, 2, 4 };
+	const int blockSize = 256, numBlocks = 400;
+
+	printf("oversampling: 1 channel, 100 ms delay, blocks of %d, ns/sample for saturation off/2x/4x\n", blockSize);
+
+	for (int isa = 0; isa < DelayKernels::numIsas; ++isa)
+	{
+		if (! DelayKernels::isSupported(DelayKernels::Isa(isa)))
+			continue;
+
+		for (int shimmer = 0; shimmer < 2; ++shimmer)
+		{
+			std::vector<std::vector<SaturationInstance> > instances(numSaturationModes);
+			double best[numSaturationModes];
+
+			for (int f = 0; f < numSaturationModes; ++f)
+			{
+				instances[f].push_back(SaturationInstance(factors[f], shimmer != 0, DelayKernels::Isa(isa)));
+				timeInstances(instances[f], 1, blockSize, 20);
+				best[f] = 1e30;
+			}
+
+			for (int run = 0; run < numRuns; ++run)
+				for (int f = 0; f < numSaturationModes; ++f)
+					best[f] = std::min(best[f], timeInstances(instances[f], 1, blockSize, numBlocks).nsPerSample);
+
+			printf("  %-8s shimmer %-3s %7.2f %7.2f %7.2f\n", DelayKernels::getName(DelayKernels::Isa(isa)), shimmer ? "on" : "off",
+			       best[0], best[1], best[2]);
+		}
+	}
+}
+
+
+//==============================================================================
+int main(int argc, char* argv[])
+{
+	const std::string what = argc > 1 ? argv[1] : "all";
+	const int numInstances = argc > 2 ? atoi(argv[2]) : 64;
+
+	printf("kernels: %s\n", DelayKernels::getName(DelayKernels::get().isa));
+
+	if (what == "all" || what == "arena")
+		benchArena(numInstances);
+
+	if (what == "all" || what == "oversampling")
+		benchOversampling();
+
+	return 0;
+}
@@ -0,0 +1,147 @@
+/*
+
+"DelayTestUtils" helpers for the standalone DSP tests.
+
+The DSP classes in Source/ that do not depend on JUCE (UniversalComb,
+DelayKernels, DelayArena, PitchShifter, Oversampler, PolyphaseResampler)
+are built on their own in Tests/, so they can be checked without a host
+or the JUCE modules. This header holds the shared test signals, the
+comparisons (bit-exact or within a tolerance) and a minimal pass/fail
+counter; every test program returns the number of failed checks.
+
+Date: 29/03/2017
+Plugin Name: Delay
+Author: Dimitris Koutsaidis
+
+to do:
+
+*/
+
+#ifndef DELAYTESTUTILS_H_INCLUDED
+#define DELAYTESTUTILS_H_INCLUDED
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <random>
+#include <vector>
+
+
+namespace DelayTest
+{
+	// Pass/fail bookkeeping
+	struct Results
+	{
+		Results() : numChecks(0), numFailures(0) {}
+
+		void expect(bool condition, const char* what)
+		{
+			++numChecks;
+
+			if (! condition)
+			{
+				// Only the first few failures are printed, the count is what matters
+				if (++numFailures <= 20)
+					printf("FAILED: %s\n", what);
+			}
+		}
+
+		int finish(const char* suiteName) const
+		{
+			printf("%s: %d checks, %d failed\n", suiteName, numChecks, numFailures);
+			return numFailures > 0 ? 1 : 0;
+		}
+
+		int numChecks, numFailures;
+	};
+
+
+	template <typename T, int N>
+	inline int numElements(const T (&)[N])          { return N; }
+
+
+	// Test signals
+	enum Signal
+	{
+		impulse = 0,
+		sweep,
+		noise,
+		numSignals
+	};
+
+	inline const char* getSignalName(int signal)
+	{
+		const char* const names[] = { "impulse", "sweep", "noise" };
+		return names[signal];
+	}
+
+	// Unit impulse, exponential sine sweep from 20 Hz to 20 kHz (at 48 kHz) or white noise in [-0.5, 0.5)
+	inline std::vector<float> makeSignal(int signal, int numSamples, std::mt19937& random)
+	{
+		std::vector<float> x(numSamples, 0.0f);
+
+		if (signal == impulse)
+		{
+			if (numSamples > 0)
+				x[0] = 1.0f;
+		}
+		else if (signal == sweep)
+		{
+			const double pi = 3.14159265358979323846;
+			const double f0 = 20.0/48000.0, f1 = 20000.0/48000.0;
+			const double k = log(f1/f0)/numSamples;
+
+			for (int i = 0; i < numSamples; ++i)
+				x[i] = float(0.5*sin(2.0*pi*f0*(exp(k*i) - 1.0)/k));
+		}
+		else
+		{
+			std::uniform_real_distribution<float> dist(-0.5f, 0.5f);
+
+			for (int i = 0; i < numSamples; ++i)
+				x[i] = dist(random);
+		}
+
+		return x;
+	}
+
+
+	// Comparisons
+	inline bool isBitExact(const float* a, const float* b, int numSamples)
+	{
+		return memcmp(a, b, sizeof(float)*size_t(numSamples)) == 0;
+	}
+
+	// |a - b| <= tolerance*max(1, peak of b), sample by sample
+	inline bool isWithinTolerance(const float* a, const float* b, int numSamples, double tolerance)
+	{
+		double peak = 1.0;
+		for (int i = 0; i < numSamples; ++i)
+			peak = fabs(b[i]) > peak ? fabs(b[i]) : peak;
+
+		for (int i = 0; i < numSamples; ++i)
+			if (! (fabs(double(a[i]) - b[i]) <= tolerance*peak))
+				return false;
+
+		return true;
+	}
+
+	// Error energy of a against b, in dB relative to the energy of b
+	inline double getErrorDb(const float* a, const float* b, int numSamples)
+	{
+		double error = 0.0, energy = 1e-30;
+
+		for (int i = 0; i < numSamples; ++i)
+		{
+			const double d = double(a[i]) - b[i];
+			error += d*d;
+			energy += double(b[i])*b[i];
+		}
+
+		return 10.0*log10(error/energy + 1e-30);
+	}
+}
+
+
+#endif  // DELAYTESTUTILS_H_INCLUDED
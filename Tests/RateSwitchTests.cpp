@@ -0,0 +1,175 @@
+/*
+
+"RateSwitchTests" test program.
+
+Switches the sample rate of a "DelayState" rapidly between the usual host
+rates while a 1 kHz tone is running through the delay, and checks that
+
+	- every switch leaves exactly one live arena, whose size depends only
+	  on the rate (no leaks, no growth), and nothing once it is destroyed
+	- no switch takes longer than maxSwitchMs
+	- the delayed tone carries on at 1 kHz and at the same level after
+	  each switch, i.e. the tail was resampled rather than dropped
+	- preparing with no channels and then with some again works
+
+Date: 29/03/2017
+Plugin Name: Delay
+Author: Dimitris Koutsaidis
+
+to do:
+
+*/
+
+
+#include "DelayTestUtils.h"
+#include "DelayState.h"
+#include <chrono>
+#include <map>
+
+using namespace DelayTest;
+
+
+enum
+{
+	numChannels = 2,
+	numSwitches = 60,
+	maxSwitchMs = 250,
+	delayMs = 100
+};
+
+// Tone through a pure delay (BL = FB = 0, FF = 1) of delayMs, continuing from "phase"
+static std::vector<float> runTone(DelayState& state, int numSamples, double& phase)
+{
+	const double pi = 3.14159265358979323846;
+	const double sampleRate = state.getSampleRate();
+	std::vector<float> x(numSamples), y(numSamples);
+	double p = phase;
+
+	for (int i = 0; i < numSamples; ++i)
+	{
+		x[i] = float(sin(p));
+		p += 2.0*pi*1000.0/sampleRate;
+	}
+
+	CombCoefficients c;
+	c.BL = 0.0f;
+	c.FB = 0.0f;
+	c.FF = 1.0f;
+
+	for (int ch = 0; ch < state.getNumChannels(); ++ch)
+	{
+		std::vector<float> out(numSamples);
+		state.getComb(ch).setDelay(int(delayMs*sampleRate/1000.0 + 0.5));
+		state.getComb(ch).setCoefficients(c);
+		state.getComb(ch).process(x.data(), out.data(), numSamples);
+
+		if (ch == 0)
+			y = out;
+	}
+
+	phase = fmod(p, 2.0*pi);
+	return y;
+}
+
+static double elapsedMs(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void testRapidSwitching(Results& results)
+{
+	const double rates[] = { 44100.0, 48000.0, 96000.0, 88200.0, 192000.0, 22050.0, 48000.0, 32000.0 };
+	std::map<double, long long> bytesPerRate;
+	double worstMs = 0.0;
+
+	{
+		DelayState state;
+		state.prepare(rates[0], numChannels);
+
+		double phase = 0.0;
+		runTone(state, int(rates[0]), phase);
+
+		for (int i = 1; i <= numSwitches; ++i)
+		{
+			const double rate = rates[i % numElements(rates)];
+			char what[128];
+
+			const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			state.prepare(rate, numChannels);
+			const double ms = elapsedMs(start);
+			worstMs = std::max(worstMs, ms);
+
+			snprintf(what, sizeof(what), "switch %d to %.0f Hz took %.1f ms", i, rate, ms);
+			results.expect(ms < maxSwitchMs, what);
+
+			const DelayArena::Stats stats = DelayArena::getStats();
+			snprintf(what, sizeof(what), "switch %d: %d live arenas", i, stats.numArenas);
+			results.expect(stats.numArenas == 1, what);
+
+			if (bytesPerRate.count(rate) == 0)
+				bytesPerRate[rate] = stats.liveBytes;
+
+			snprintf(what, sizeof(what), "switch %d: %lld live bytes at %.0f Hz, %lld before", i, stats.liveBytes, rate, bytesPerRate[rate]);
+			results.expect(stats.liveBytes == bytesPerRate[rate], what);
+
+			// The first delayMs of output is the tail recorded at the previous rate
+			const int n = int(delayMs*rate/1000.0);
+			const std::vector<float> y = runTone(state, n, phase);
+
+			int crossings = 0;
+			double energy = 0.0;
+
+			for (int k = n/10; k < n*9/10; ++k)
+			{
+				if (y[k - 1] < 0.0f && y[k] >= 0.0f)
+					++crossings;
+
+				energy += double(y[k])*y[k];
+			}
+
+			const double frequency = crossings/(0.8*delayMs/1000.0);
+			const double rms = sqrt(energy/(n*0.8));
+
+			snprintf(what, sizeof(what), "switch %d to %.0f Hz: tail at %.0f Hz, rms %.3f", i, rate, frequency, rms);
+			results.expect(fabs(frequency - 1000.0) < 30.0 && fabs(rms - sqrt(0.5)) < 0.02, what);
+		}
+
+		printf("worst switch %.2f ms\n", worstMs);
+	}
+
+	const DelayArena::Stats stats = DelayArena::getStats();
+	results.expect(stats.numArenas == 0 && stats.liveBytes == 0, "all arenas released");
+}
+
+static void testNoChannels(Results& results)
+{
+	DelayState state;
+	state.prepare(48000.0, numChannels);
+
+	double phase = 0.0;
+	runTone(state, 4800, phase);
+
+	state.prepare(48000.0, 0);
+	results.expect(state.getNumChannels() == 0, "no channels");
+
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	state.prepare(96000.0, numChannels);
+	const double ms = elapsedMs(start);
+
+	const DelayArena::Stats stats = DelayArena::getStats();
+	char what[128];
+	snprintf(what, sizeof(what), "channels back after none: %d arenas, %lld bytes, %.1f ms", stats.numArenas, stats.liveBytes, ms);
+	results.expect(state.getNumChannels() == numChannels && stats.numArenas == 1 && stats.liveBytes < 4*1024*1024 && ms < maxSwitchMs, what);
+}
+
+
+//==============================================================================
+int main()
+{
+	Results results;
+
+	testRapidSwitching(results);
+	testNoChannels(results);
+
+	return results.finish("RateSwitchTests");
+}
@@ -0,0 +1,333 @@
+/*
+
+"SaturationTests" test program.
+
+Checks the oversampled saturation of the comb's repeats:
+
+	- the dry term BL*xh(n) passes untouched at any drive
+	- at a small drive the saturated comb matches "UniversalCombReference"
+	  (the oversampler's latency is absorbed inside the loop; delays
+	  shorter than getLatency() + 1 samples are lengthened to that)
+	- every kernel variant gives the scalar result bit for bit, with and
+	  without the pitch shifter
+	- harmonics of a driven tone above Nyquist are suppressed instead of
+	  aliasing back, and the up/down filters delay by exactly getLatency()
+	- a jump of the drive is ramped rather than stepping the output
+
+Date: 29/03/2017
+Plugin Name: Delay
+Author: Dimitris Koutsaidis
+
+to do:
+
+*/
+
+
+#include "DelayTestUtils.h"
+#include "UniversalComb.h"
+
+using namespace DelayTest;
+
+
+static const double pi = 3.14159265358979323846;
+static const double sampleRate = 48000.0;
+
+static std::vector<float> makeSine(double frequency, double amplitude, int numSamples)
+{
+	std::vector<float> x(numSamples);
+	for (int i = 0; i < numSamples; ++i)
+		x[i] = float(amplitude*sin(2.0*pi*frequency*i/sampleRate));
+	return x;
+}
+
+// Level of one frequency in dB relative to a full-scale sine (Hann window)
+static double getLevelDb(const std::vector<float>& y, double frequency)
+{
+	const int n = int(y.size());
+	double re = 0.0, im = 0.0;
+
+	for (int i = 0; i < n; ++i)
+	{
+		const double w = 0.5 - 0.5*cos(2.0*pi*i/n);
+		re += w*y[i]*cos(2.0*pi*frequency*i/sampleRate);
+		im += w*y[i]*sin(2.0*pi*frequency*i/sampleRate);
+	}
+
+	return 20.0*log10(sqrt(re*re + im*im)/(n/4.0) + 1e-30);
+}
+
+static CombCoefficients makeCoefficients(float BL, float FB, float FF)
+{
+	CombCoefficients c;
+	c.BL = BL;
+	c.FB = FB;
+	c.FF = FF;
+	return c;
+}
+
+// A comb with a saturator (and optionally a shifter) and the storage they need
+struct SaturatedComb
+{
+	enum { maxDelay = 4800, window = 2400 };
+
+	SaturatedComb(const DelayKernels::Table& kernels, int factor, float drive, bool withShifter)
+		: line(maxDelay + 1 + window + 2), filters(Oversampler::getStorageSize()),
+		  windowTable(PitchShifter::windowTableSize), scratch(PitchShifter::scratchSize)
+	{
+		comb.setKernels(kernels);
+		comb.prepare(line.data(), maxDelay, window + 2);
+
+		saturator.prepare(filters.data());
+		saturator.setFactor(factor);
+		saturator.setDrive(drive);
+		comb.setSaturator(&saturator);
+
+		PitchShifter::fillWindowTable(windowTable.data());
+		shifter.prepare(windowTable.data(), scratch.data(), window);
+		shifter.setRatio(1.5f);
+
+		if (withShifter)
+			comb.setPitchShifter(&shifter);
+	}
+
+	// Odd block sizes, so runs split everywhere
+	std::vector<float> process(const std::vector<float>& x, int M, const CombCoefficients& c)
+	{
+		std::vector<float> y(x.size());
+		comb.setDelay(M);
+		comb.setCoefficients(c);
+
+		for (size_t pos = 0; pos < x.size(); pos += 173)
+			comb.process(&x[pos], &y[pos], int(std::min(size_t(173), x.size() - pos)));
+
+		return y;
+	}
+
+	std::vector<float> line, filters, windowTable, scratch;
+	UniversalComb comb;
+	Oversampler saturator;
+	PitchShifter shifter;
+};
+
+static std::vector<float> runReference(const std::vector<float>& x, int M, const CombCoefficients& c)
+{
+	UniversalCombReference reference(SaturatedComb::maxDelay);
+	reference.setDelay(M);
+	reference.setCoefficients(c);
+
+	std::vector<float> y(x.size());
+	for (size_t i = 0; i < x.size(); ++i)
+		y[i] = reference.processSample(x[i]);
+
+	return y;
+}
+
+
+//==============================================================================
+// A full-scale tone: until the first repeat can arrive the output is exactly BL*x, at any
+// drive. (The linear-phase filters start ringing getLatency() samples ahead of M.)
+static void testDryUnity(Results& results)
+{
+	const int M = 4800;
+	const std::vector<float> x = makeSine(1000.0, 1.0, 2*M);
+	const float drives[] = { 2.0f, 16.0f };                   // 6 and 24 dB
+
+	for (int factor = 2; factor <= 4; factor += 2)
+		for (int d = 0; d < numElements(drives); ++d)
+		{
+			SaturatedComb s(DelayKernels::get(), factor, drives[d], false);
+			const std::vector<float> y = s.process(x, M, makeCoefficients(1.0f, 0.5f, 0.25f));
+
+			char what[128];
+			snprintf(what, sizeof(what), "%dx, drive %.0f: dry signal untouched", factor, drives[d]);
+			results.expect(isBitExact(y.data(), x.data(), M - Oversampler::getLatency(factor)), what);
+		}
+}
+
+// Sum of equal sines at "frequencies"
+template <int N>
+static std::vector<float> makeTones(const double (&frequencies)[N], int numSamples)
+{
+	std::vector<float> x(numSamples, 0.0f);
+
+	for (int f = 0; f < N; ++f)
+	{
+		const std::vector<float> tone = makeSine(frequencies[f], 0.5/N, numSamples);
+		for (int i = 0; i < numSamples; ++i)
+			x[i] += tone[i];
+	}
+
+	return x;
+}
+
+// At a small drive the saturator is transparent, so the comb is the plain universal comb. The
+// up/down filters remove the band near Nyquist, hence tones rather than white noise; their
+// passband ripple builds up through the feedback, so the high tones get a looser bound.
+static void testAgainstReference(Results& results)
+{
+	const double low[] = { 110.0, 440.0, 1234.5 };
+	const double wide[] = { 110.0, 440.0, 1234.5, 3100.0, 7000.0, 12000.0 };
+	const std::vector<float> signals[] = { makeTones(low, 20000), makeTones(wide, 20000) };
+	const char* const names[] = { "up to 1.2 kHz", "up to 12 kHz" };
+	const double limitsDb[] = { -75.0, -60.0 };
+
+	const CombCoefficients c = makeCoefficients(0.7f, 0.6f, 0.3f);
+	const int delays[] = { 5, 100, 1000, 4800 };
+
+	for (int factor = 2; factor <= 4; factor += 2)
+		for (int d = 0; d < numElements(delays); ++d)
+			for (int sig = 0; sig < numElements(names); ++sig)
+			{
+				const std::vector<float>& x = signals[sig];
+				SaturatedComb s(DelayKernels::get(), factor, 1e-3f, false);
+				const std::vector<float> y = s.process(x, delays[d], c);
+
+				const int effectiveM = std::max(delays[d], Oversampler::getLatency(factor) + 1);
+				const std::vector<float> reference = runReference(x, effectiveM, c);
+				const double errorDb = getErrorDb(y.data(), reference.data(), int(x.size()));
+
+				char what[128];
+				snprintf(what, sizeof(what), "%dx, M = %d, tones %s: %.1f dB from the reference", factor, delays[d], names[sig], errorDb);
+				results.expect(errorDb < limitsDb[sig], what);
+			}
+}
+
+static void testVariants(Results& results)
+{
+	const std::vector<float> x = makeSine(440.0, 0.8, 12000);
+	const CombCoefficients c = makeCoefficients(1.0f, 0.7f, 0.5f);
+
+	for (int factor = 2; factor <= 4; factor += 2)
+		for (int withShifter = 0; withShifter < 2; ++withShifter)
+		{
+			SaturatedComb scalar(DelayKernels::get(DelayKernels::scalar), factor, 4.0f, withShifter != 0);
+			const std::vector<float> expected = scalar.process(x, 3000, c);
+
+			for (int isa = 1; isa < DelayKernels::numIsas; ++isa)
+			{
+				if (! DelayKernels::isSupported(DelayKernels::Isa(isa)))
+					continue;
+
+				SaturatedComb s(DelayKernels::get(DelayKernels::Isa(isa)), factor, 4.0f, withShifter != 0);
+				const std::vector<float> y = s.process(x, 3000, c);
+
+				char what[128];
+				snprintf(what, sizeof(what), "%dx%s, %s: bit-exact against scalar", factor, withShifter ? " with shifter" : "",
+				         DelayKernels::getName(DelayKernels::Isa(isa)));
+				results.expect(isBitExact(y.data(), expected.data(), int(x.size())), what);
+			}
+		}
+}
+
+// 7 kHz at +12 dB: the 5th and 7th harmonics (35 and 49 kHz) would alias to 13 and 1 kHz
+static void testAliasing(Results& results)
+{
+	const int n = 48000;
+	const DelayKernels::Table& kernels = DelayKernels::get();
+
+	std::vector<float> plain = makeSine(7000.0, 0.5, n);
+	kernels.saturate(plain.data(), 4.0f, 1.0f, n);
+	const double plainAlias = std::max(getLevelDb(plain, 13000.0), getLevelDb(plain, 1000.0));
+	printf("without oversampling: aliases at %.1f dB\n", plainAlias);
+
+	results.expect(plainAlias > -60.0, "aliasing is measurable without oversampling");
+
+	for (int factor = 2; factor <= 4; factor += 2)
+	{
+		std::vector<float> filters(Oversampler::getStorageSize());
+		Oversampler saturator;
+		saturator.prepare(filters.data());
+		saturator.setFactor(factor);
+		saturator.setDrive(4.0f);
+		saturator.reset();
+
+		std::vector<float> y = makeSine(7000.0, 0.5, n);
+		for (int pos = 0; pos < n; pos += Oversampler::maxBlock)
+			saturator.process(&y[pos], std::min(int(Oversampler::maxBlock), n - pos), kernels);
+
+		for (int i = 0; i < n; ++i)
+			y[i] *= 4.0f;
+
+		const double alias = std::max(getLevelDb(y, 13000.0), getLevelDb(y, 1000.0));
+
+		char what[128];
+		snprintf(what, sizeof(what), "%dx: aliases at %.1f dB, harmonic at 21 kHz %.1f dB", factor, alias, getLevelDb(y, 21000.0));
+		results.expect(alias < -90.0 && getLevelDb(y, 21000.0) > -30.0, what);
+	}
+}
+
+// At a small drive the oversampler is a pure delay of getLatency() samples
+static void testLatency(Results& results)
+{
+	const int n = 24000;
+	const std::vector<float> x = makeSine(1000.0, 0.5, n);
+
+	for (int factor = 2; factor <= 4; factor += 2)
+	{
+		std::vector<float> filters(Oversampler::getStorageSize());
+		Oversampler saturator;
+		saturator.prepare(filters.data());
+		saturator.setFactor(factor);
+		saturator.setDrive(1e-3f);
+		saturator.reset();
+
+		std::vector<float> y(x);
+		for (int pos = 0; pos < n; pos += 100)
+			saturator.process(&y[pos], std::min(100, n - pos), DelayKernels::get());
+
+		const int latency = saturator.getLatency();
+		const double errorDb = getErrorDb(&y[1000], &x[1000 - latency], n - 1000);
+
+		char what[128];
+		snprintf(what, sizeof(what), "%dx: delay of %d samples, %.1f dB error", factor, latency, errorDb);
+		results.expect(errorDb < -90.0, what);
+	}
+}
+
+// Drive automation from 0 to 24 dB and back at block boundaries. With a constant input the
+// output only moves with the gain, which steps by 0.4 at once without the ramp.
+static void testDriveRamp(Results& results)
+{
+	const int n = 8192;
+	const std::vector<float> x(n, 0.5f);
+
+	for (int factor = 2; factor <= 4; factor += 2)
+	{
+		std::vector<float> filters(Oversampler::getStorageSize());
+		Oversampler saturator;
+		saturator.prepare(filters.data());
+		saturator.setFactor(factor);
+		saturator.reset();
+
+		std::vector<float> y(x);
+		for (int pos = 0; pos < n; pos += 128)
+		{
+			saturator.setDrive((pos >= 2048 && pos < 5120) ? 16.0f : 1.0f);
+			saturator.process(&y[pos], 128, DelayKernels::get());
+		}
+
+		float step = 0.0f;
+		for (int i = 1025; i < n; ++i)
+			step = std::max(step, fabsf(y[i] - y[i - 1]));
+
+		char what[128];
+		snprintf(what, sizeof(what), "%dx: drive jumps without zipper (step %.3f)", factor, step);
+		results.expect(step < 0.01f, what);
+	}
+}
+
+
+//==============================================================================
+int main()
+{
+	Results results;
+
+	testDryUnity(results);
+	testAgainstReference(results);
+	testVariants(results);
+	testAliasing(results);
+	testLatency(results);
+	testDriveRamp(results);
+
+	return results.finish("SaturationTests");
+}